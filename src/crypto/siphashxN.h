@@ -7,11 +7,20 @@
 #define XOR(a, b) _mm256_xor_si256(a, b)
 #define ROTATE16 _mm256_set_epi64x(0x0D0C0B0A09080F0EULL,0x0504030201000706ULL, \
                                    0x0D0C0B0A09080F0EULL, 0x0504030201000706ULL)
+#ifdef __AVX512VL__
+// native 64-bit rotates (vprolq) on 256-bit registers
+#define ROT13(x) _mm256_rol_epi64(x,13)
+#define ROT16(x) _mm256_rol_epi64(x,16)
+#define ROT17(x) _mm256_rol_epi64(x,17)
+#define ROT21(x) _mm256_rol_epi64(x,21)
+#define ROT32(x) _mm256_rol_epi64(x,32)
+#else
 #define ROT13(x) _mm256_or_si256(_mm256_slli_epi64(x,13),_mm256_srli_epi64(x,51))
 #define ROT16(x) _mm256_shuffle_epi8((x), ROTATE16)
 #define ROT17(x) _mm256_or_si256(_mm256_slli_epi64(x,17),_mm256_srli_epi64(x,47))
 #define ROT21(x) _mm256_or_si256(_mm256_slli_epi64(x,21),_mm256_srli_epi64(x,43))
 #define ROT32(x) _mm256_shuffle_epi32((x), _MM_SHUFFLE(2, 3, 0, 1))
+#endif
 
 #elif defined __SSE2__
 
@@ -88,6 +97,8 @@ void siphash24x4(const siphash_keys *keys, const uint64_t *indices, uint64_t *ha
   _mm256_store_si256((__m256i *)hashes, XOR(XOR(v0,v1),XOR(v2,v3)));
 }
 
+#ifndef __AVX512F__
+
 // 8-way sipHash-2-4 specialized to precomputed key and 8 byte nonces
 void siphash24x8(const siphash_keys *keys, const uint64_t *indices, uint64_t *hashes) {
   const __m256i packet0 = _mm256_load_si256((__m256i *)indices);
@@ -134,7 +145,75 @@ void siphash24x16(const siphash_keys *keys, const uint64_t *indices, uint64_t *h
   _mm256_store_si256((__m256i *)(hashes+12), XOR(XOR(vC,vD),XOR(vE,vF)));
 }
 
-#elif defined __SSE2__
+#endif // ifndef __AVX512F__
+
+#endif
+
+#ifdef __AVX512F__
+
+// a 512-bit register holds 8 lanes, and every rotate is a single vprolq
+#define ADD512(a, b) _mm512_add_epi64(a, b)
+#define XOR512(a, b) _mm512_xor_si512(a, b)
+// (the all-ones zero mask compiles to plain vprolq, and avoids a bogus
+// uninitialized warning for _mm512_rol_epi64 in some versions of gcc)
+#define ROT512(x, b) _mm512_maskz_rol_epi64((__mmask8)-1, x, b)
+// a^b^c in one vpternlogq
+#define XOR3512(a, b, c) _mm512_ternarylogic_epi64(a, b, c, 0x96)
+
+#define SIPROUND512(v0, v1, v2, v3) \
+  do { \
+    v0 = ADD512(v0,v1); v2 = ADD512(v2,v3); v1 = ROT512(v1,13); \
+    v3 = ROT512(v3,16); v1 = XOR512(v1,v0); v3 = XOR512(v3,v2); \
+    v0 = ROT512(v0,32); v2 = ADD512(v2,v1); v0 = ADD512(v0,v3); \
+    v1 = ROT512(v1,17);                     v3 = ROT512(v3,21); \
+    v1 = XOR512(v1,v2); v3 = XOR512(v3,v0); v2 = ROT512(v2,32); \
+  } while(0)
+
+// sipHash-2-4 of 8*N nonces in N interleaved sets of 512-bit state registers.
+// N is a compile-time constant at every call, so all loops are unrolled
+static inline __attribute__((always_inline))
+void siphash24x8N(const siphash_keys *keys, const uint64_t *indices, uint64_t *hashes, const int N) {
+  __m512i v0[4], v1[4], v2[4], v3[4], packet[4];
+  const __m512i ff = _mm512_set1_epi64(0xffLL);
+  for (int i = 0; i < N; i++) {
+    packet[i] = _mm512_load_si512((__m512i *)(indices + 8*i));
+    v0[i] = _mm512_set1_epi64(keys->k0);
+    v1[i] = _mm512_set1_epi64(keys->k1);
+    v2[i] = _mm512_set1_epi64(keys->k2);
+    v3[i] = XOR512(_mm512_set1_epi64(keys->k3), packet[i]);
+  }
+  for (int r = 0; r < 2; r++)
+    for (int i = 0; i < N; i++)
+      SIPROUND512(v0[i], v1[i], v2[i], v3[i]);
+  for (int i = 0; i < N; i++) {
+    v0[i] = XOR512(v0[i], packet[i]);
+    v2[i] = XOR512(v2[i], ff);
+  }
+  for (int r = 0; r < 4; r++)
+    for (int i = 0; i < N; i++)
+      SIPROUND512(v0[i], v1[i], v2[i], v3[i]);
+  for (int i = 0; i < N; i++)
+    _mm512_store_si512((__m512i *)(hashes + 8*i), XOR512(XOR3512(v0[i], v1[i], v2[i]), v3[i]));
+}
+
+// 8-way sipHash-2-4 specialized to precomputed key and 8 byte nonces
+void siphash24x8(const siphash_keys *keys, const uint64_t *indices, uint64_t *hashes) {
+  siphash24x8N(keys, indices, hashes, 1);
+}
+
+// 16-way sipHash-2-4 specialized to precomputed key and 8 byte nonces
+void siphash24x16(const siphash_keys *keys, const uint64_t *indices, uint64_t *hashes) {
+  siphash24x8N(keys, indices, hashes, 2);
+}
+
+// 32-way sipHash-2-4 specialized to precomputed key and 8 byte nonces
+void siphash24x32(const siphash_keys *keys, const uint64_t *indices, uint64_t *hashes) {
+  siphash24x8N(keys, indices, hashes, 4);
+}
+
+#endif // ifdef __AVX512F__
+
+#if !defined __AVX2__ && defined __SSE2__
 
 // 2-way sipHash-2-4 specialized to precomputed key and 8 byte nonces
 void siphash24x2(const siphash_keys *keys, const uint64_t *indices, uint64_t *hashes) {
@@ -189,6 +268,7 @@ void siphash24x4(const siphash_keys *keys, const uint64_t *indices, uint64_t *ha
 // currently 1, 2, 4, 8 are supported, but
 // more than 1 requires the use of sse2 or avx2
 // more than 4 requires the use of avx2
+// 32 requires the use of avx512f
 #define NSIPHASH 1
 #endif
 
@@ -203,6 +283,8 @@ void siphash24xN(const siphash_keys *keys, const uint64_t *indices, uint64_t * h
   siphash24x8(keys, indices, hashes);
 #elif NSIPHASH == 16
   siphash24x16(keys, indices, hashes);
+#elif NSIPHASH == 32
+  siphash24x32(keys, indices, hashes);
 #else
 #error not implemented
 #endif
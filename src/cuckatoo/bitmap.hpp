@@ -40,6 +40,16 @@ public:
     std::atomic_fetch_or_explicit(&bits[idx], bit, std::memory_order_relaxed);
 #else
     bits[idx] |= bit;
+#endif
+  }
+  // set by the only thread updating u's word for now, sparing the atomic
+  void setsole(u32 u) {
+    u32 idx = u / BITS_PER_WORD;
+    word_t bit = (word_t)1 << (u % BITS_PER_WORD);
+#ifdef ATOMIC
+    bits[idx].store(bits[idx].load(std::memory_order_relaxed) | bit, std::memory_order_relaxed);
+#else
+    bits[idx] |= bit;
 #endif
   }
   void reset(u32 u) {
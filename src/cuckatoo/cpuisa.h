@@ -0,0 +1,32 @@
+// Cuckatoo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2019 John Tromp
+
+// the instruction sets mean miner instances are built for, as picked at
+// runtime by dispatch.cpp and libcuckatoo.cpp
+
+#ifndef INCLUDE_CPUISA_H
+#define INCLUDE_CPUISA_H
+
+// in order of preference
+enum isa { AVX512, AVX2, SSE4, NISAS };
+static const char *isanames[] = { "avx512", "avx2", "sse4" };
+
+static bool cpusupports(const int i) {
+  __builtin_cpu_init();
+  switch (i) {
+    case AVX512: return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl")
+                     && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq");
+    case AVX2:   return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2");
+    case SSE4:   return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"); // as -march=nehalem
+  }
+  return false;
+}
+
+// the most preferred one this cpu supports, or NISAS if none
+static int cpuisa() {
+  int i;
+  for (i = 0; i < NISAS && !cpusupports(i); i++) ;
+  return i;
+}
+
+#endif // ifdef INCLUDE_CPUISA_H
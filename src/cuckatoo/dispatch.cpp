@@ -0,0 +1,371 @@
+// Cuckatoo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2019 John Tromp
+
+// a single mean miner binary for many graph sizes and instruction sets,
+// picked with -e EDGEBITS and by cpuid, or -i ISA to override the latter.
+// each combination is a separate instance (see meaninst.cpp) with its own
+// compile-time constants, so dispatch costs one call and nothing more.
+// each combination also comes in a few bucket layout variants, one of which
+// is picked with -l LAYOUT, or by the profile that -A writes after timing
+// them all on this machine (to the file named by -P, if any). the lm layout instead trades time for half the
+// memory, on machines too small for the others
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <vector>
+#include "cpuisa.h"
+
+#define DEFAULT_EDGEBITS 29
+// read at startup, unless -P names another, or none with -P ""
+#define DEFAULT_PROFILE "cuckatoo.prof"
+
+// as built by the Makefile's layout_* flags
+enum layout { STD, XP, S16, WC, LM, NLAYOUTS };
+const char *layoutnames[] = { "std", "xp", "s16", "wc", "lm" };
+
+#define DECLARE_INSTANCE(N,I,L) namespace cuckatoo##N##I##L { int main(int argc, char **argv); }
+#define DECLARE_INSTANCES(N) \
+  DECLARE_INSTANCE(N,avx512,std) DECLARE_INSTANCE(N,avx512,xp) DECLARE_INSTANCE(N,avx512,s16) DECLARE_INSTANCE(N,avx512,wc) \
+  DECLARE_INSTANCE(N,avx512,lm) \
+  DECLARE_INSTANCE(N,avx2,std) DECLARE_INSTANCE(N,avx2,xp) DECLARE_INSTANCE(N,avx2,wc) DECLARE_INSTANCE(N,avx2,lm) \
+  DECLARE_INSTANCE(N,sse4,std) DECLARE_INSTANCE(N,sse4,xp) DECLARE_INSTANCE(N,sse4,lm)
+DECLARE_INSTANCES(19)
+DECLARE_INSTANCES(24)
+DECLARE_INSTANCES(25)
+DECLARE_INSTANCES(26)
+DECLARE_INSTANCES(27)
+DECLARE_INSTANCES(28)
+DECLARE_INSTANCES(29)
+DECLARE_INSTANCES(30)
+DECLARE_INSTANCES(31)
+DECLARE_INSTANCES(32)
+
+typedef int (*mainfn)(int argc, char **argv);
+typedef struct {
+  int edgebits;
+  mainfn main[NISAS][NLAYOUTS]; // 0 for layouts not built for an isa
+} instance;
+
+#define INSTANCES(N) {N, { \
+  {cuckatoo##N##avx512std::main, cuckatoo##N##avx512xp::main, cuckatoo##N##avx512s16::main, cuckatoo##N##avx512wc::main, cuckatoo##N##avx512lm::main}, \
+  {cuckatoo##N##avx2std::main, cuckatoo##N##avx2xp::main, 0, cuckatoo##N##avx2wc::main, cuckatoo##N##avx2lm::main}, \
+  {cuckatoo##N##sse4std::main, cuckatoo##N##sse4xp::main, 0, 0, cuckatoo##N##sse4lm::main}}}
+// without xp, or lm, as per NOLAYOUTS in the Makefile
+#define INSTANCESNOXP(N) {N, { \
+  {cuckatoo##N##avx512std::main, 0, cuckatoo##N##avx512s16::main, cuckatoo##N##avx512wc::main, cuckatoo##N##avx512lm::main}, \
+  {cuckatoo##N##avx2std::main, 0, 0, cuckatoo##N##avx2wc::main, cuckatoo##N##avx2lm::main}, \
+  {cuckatoo##N##sse4std::main, 0, 0, 0, cuckatoo##N##sse4lm::main}}}
+#define INSTANCESNOLM(N) {N, { \
+  {cuckatoo##N##avx512std::main, cuckatoo##N##avx512xp::main, cuckatoo##N##avx512s16::main, cuckatoo##N##avx512wc::main, 0}, \
+  {cuckatoo##N##avx2std::main, cuckatoo##N##avx2xp::main, 0, cuckatoo##N##avx2wc::main, 0}, \
+  {cuckatoo##N##sse4std::main, cuckatoo##N##sse4xp::main, 0, 0, 0}}}
+static const instance instances[] = {
+  INSTANCESNOXP(19),
+  INSTANCESNOLM(24),
+  INSTANCESNOLM(25),
+  INSTANCESNOLM(26),
+  INSTANCESNOLM(27),
+  INSTANCESNOLM(28),
+  INSTANCES(29),
+  INSTANCES(30),
+  INSTANCES(31),
+  INSTANCES(32),
+};
+#define NINSTANCES (sizeof(instances) / sizeof(instance))
+
+// find argument of option -o without disturbing getopt state; the instance parses it again
+const char *optionarg(int argc, char **argv, const char o) {
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--"))
+      break;
+    if (argv[i][0] == '-' && argv[i][1] == o)
+      return argv[i][2] ? argv[i]+2 : i+1 < argc ? argv[i+1] : "";
+  }
+  return 0;
+}
+
+// remove option -o and its argument, if it takes one, which are for us rather than the instance
+int dropoption(int argc, char **argv, const char o, const bool hasarg = true) {
+  int j = 1;
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] == '-' && argv[i][1] == o) {
+      if (hasarg && !argv[i][2] && i+1 < argc)
+        i++;
+    } else argv[j++] = argv[i];
+  }
+  argv[j] = 0;
+  return j;
+}
+
+int lookup(const char *name, const char **names, const int n) {
+  int i;
+  for (i = 0; i < n && strcmp(name, names[i]); i++) ;
+  return i;
+}
+
+// a profile has lines "edgebits isa layout compressround", the latter 0 for
+// the instance default, as written by autotune below
+typedef struct {
+  int layout;
+  int compressround;
+} tuning;
+
+bool readprofile(const char *path, const instance &inst, const int isa, tuning *t) {
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return false;
+  char line[256], isaname[32], layoutname[32];
+  int eb, cr;
+  bool found = false;
+  while (!found && fgets(line, sizeof(line), f)) {
+    if (line[0] == '#' || sscanf(line, "%d %31s %31s %d", &eb, isaname, layoutname, &cr) != 4)
+      continue;
+    int l = lookup(layoutname, layoutnames, NLAYOUTS);
+    if (eb == inst.edgebits && lookup(isaname, isanames, NISAS) == isa && l < NLAYOUTS && inst.main[isa][l]) {
+      t->layout = l;
+      t->compressround = cr;
+      found = true;
+    }
+  }
+  fclose(f);
+  return found;
+}
+
+// replace any line for edgebits and isa
+void writeprofile(const char *path, const int edgebits, const int isa, const tuning &t) {
+  char lines[64][256];
+  int nlines = 0, eb;
+  char isaname[32];
+  FILE *f = fopen(path, "r");
+  if (f) {
+    while (nlines < 64 && fgets(lines[nlines], sizeof(lines[0]), f))
+      if (lines[nlines][0] == '#' || sscanf(lines[nlines], "%d %31s", &eb, isaname) != 2
+          || eb != edgebits || strcmp(isaname, isanames[isa]))
+        nlines++;
+    fclose(f);
+  }
+  f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    exit(1);
+  }
+  if (!nlines)
+    fprintf(f, "# edgebits isa layout compressround, as written by cuckatoo -A\n");
+  for (int i = 0; i < nlines; i++)
+    fputs(lines[i], f);
+  fprintf(f, "%d %s %s %d\n", edgebits, isanames[isa], layoutnames[t.layout], t.compressround);
+  fclose(f);
+}
+
+// what one candidate run found, and how long its solves took
+typedef struct {
+  bool ok;
+  unsigned timems;
+  unsigned nsols;
+  char sols[4096];  // all Solution lines, concatenated
+  char trims[1024]; // all "trimmed to" lines, the edges left after trimming
+} outcome;
+
+// nonces to search for a graph with solutions, when -n leaves it to us
+#define MAXTUNENONCES 256
+
+// run this very binary on the remaining arguments with the given tuning,
+// in a separate process so that a crashing candidate is merely rejected.
+// nonce, unless negative, starts the range instead of any -n option
+outcome runcandidate(int argc, char **argv, const int edgebits, const int isa, const tuning &t, const int nonce) {
+  outcome o;
+  o.ok = false;
+  o.timems = o.nsols = 0;
+  o.sols[0] = o.trims[0] = 0;
+  int fds[2];
+  if (pipe(fds))
+    return o;
+  pid_t pid = fork();
+  if (pid < 0)
+    return o;
+  if (!pid) {
+    char eb[16], cr[16], nc[16];
+    snprintf(eb, sizeof(eb), "%d", edgebits);
+    snprintf(cr, sizeof(cr), "%d", t.compressround);
+    snprintf(nc, sizeof(nc), "%d", nonce);
+    const char **args = (const char **)malloc((argc + 18) * sizeof(char *));
+    int n = 0;
+    args[n++] = argv[0];
+    args[n++] = "-P"; args[n++] = "";
+    args[n++] = "-s"; // to have solutions printed for comparison
+    args[n++] = "-r"; args[n++] = "4"; // unless overridden below
+    if (nonce >= 0) {
+      args[n++] = "-n"; args[n++] = nc;
+    }
+    for (int i = 1; i < argc; i++)
+      args[n++] = argv[i];
+    args[n++] = "-e"; args[n++] = eb;
+    args[n++] = "-i"; args[n++] = isanames[isa];
+    args[n++] = "-l"; args[n++] = layoutnames[t.layout];
+    if (t.compressround) {
+      args[n++] = "-c"; args[n++] = cr;
+    }
+    args[n] = 0;
+    close(fds[0]);
+    dup2(fds[1], STDOUT_FILENO);
+    dup2(fds[1], STDERR_FILENO);
+    execv("/proc/self/exe", (char **)args);
+    _exit(127);
+  }
+  close(fds[1]);
+  FILE *f = fdopen(fds[0], "r");
+  char line[1024];
+  unsigned ms;
+  size_t len = 0, tlen = 0;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "Time: %u ms", &ms) == 1)
+      o.timems += ms;
+    else if (!strncmp(line, "Solution", 8) && len + strlen(line) < sizeof(o.sols)) {
+      strcpy(o.sols + len, line);
+      len += strlen(line);
+      o.nsols++;
+    } else if (!strncmp(line, "trimmed to", 10) && tlen + strlen(line) < sizeof(o.trims)) {
+      strcpy(o.trims + tlen, line);
+      tlen += strlen(line);
+    }
+  }
+  fclose(f);
+  int status;
+  o.ok = waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  return o;
+}
+
+// time every layout at a range of compression rounds on the same nonces,
+// rejecting any that do not reproduce the default's edge counts and
+// solutions, and record the fastest in the profile
+int autotune(int argc, char **argv, const instance &inst, const int isa, const char *profile) {
+  static const int compressrounds[] = { 0, 10, 14, 18, 22, 26 };
+  const int ncr = sizeof(compressrounds) / sizeof(int);
+  tuning t = { STD, 0 }, best = t;
+  argc = dropoption(argc, argv, 'l'); // candidates pick their own
+  argc = dropoption(argc, argv, 'c');
+  printf("Autotuning EDGEBITS %d on %s into %s\n", inst.edgebits, isanames[isa], profile);
+  // without solutions to compare, a candidate could trim wrongly and go unnoticed
+  // but for the edge counts, so unless told otherwise, look for nonces with some
+  int nonce = -1;
+  outcome ref = runcandidate(argc, argv, inst.edgebits, isa, t, nonce);
+  if (!optionarg(argc, argv, 'n')) {
+    const char *arg = optionarg(argc, argv, 'r');
+    const int range = arg && atoi(arg) > 0 ? atoi(arg) : 4;
+    const outcome first = ref;
+    for (nonce = 0; ref.ok && !ref.nsols && nonce + range < MAXTUNENONCES; ) {
+      nonce += range;
+      ref = runcandidate(argc, argv, inst.edgebits, isa, t, nonce);
+    }
+    if (ref.ok && !ref.nsols) {
+      printf("No solutions in nonces 0-%d; comparing edge counts only\n", nonce + range - 1);
+      nonce = 0;
+      ref = first;
+    } else if (ref.ok)
+      printf("Comparing %u solutions from nonce %d on\n", ref.nsols, nonce);
+  }
+  if (!ref.ok) {
+    printf("Default std layout failed; nothing to tune against\n");
+    return 1;
+  }
+  unsigned besttime = ~0U; // the reference run doubles as warmup, and is timed again
+  for (t.layout = 0; t.layout < NLAYOUTS; t.layout++) {
+    if (!inst.main[isa][t.layout] || t.layout == LM) // never the fastest
+      continue;
+    for (int c = 0; c < ncr; c++) {
+      t.compressround = compressrounds[c];
+      outcome o = runcandidate(argc, argv, inst.edgebits, isa, t, nonce);
+      printf("%4s compressround ", layoutnames[t.layout]);
+      if (t.compressround)
+        printf("%2d", t.compressround);
+      else printf("df");
+      if (!o.ok)
+        printf(" failed\n");
+      else if (strcmp(o.trims, ref.trims))
+        printf(" %6u ms, rejected for differing edge counts\n", o.timems);
+      else if (strcmp(o.sols, ref.sols))
+        printf(" %6u ms, rejected for differing solutions\n", o.timems);
+      else {
+        printf(" %6u ms\n", o.timems);
+        if (o.timems < besttime) {
+          besttime = o.timems;
+          best = t;
+        }
+      }
+    }
+  }
+  if (besttime == ~0U) {
+    printf("Every candidate failed or was rejected; %s left unchanged\n", profile);
+    return 1;
+  }
+  printf("Fastest is %s layout at compression round ", layoutnames[best.layout]);
+  if (best.compressround)
+    printf("%d", best.compressround);
+  else printf("default");
+  printf(", in %u ms\n", besttime);
+  writeprofile(profile, inst.edgebits, isa, best);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  const char *arg = optionarg(argc, argv, 'e');
+  int edgebits = arg ? atoi(arg) : DEFAULT_EDGEBITS;
+  int i;
+  if ((arg = optionarg(argc, argv, 'i'))) {
+    i = lookup(arg, isanames, NISAS);
+    if (i == NISAS || !cpusupports(i)) {
+      printf("Instruction set %s unknown or unsupported by this cpu\n", arg);
+      return 1;
+    }
+  } else if ((i = cpuisa()) == NISAS) {
+    printf("This cpu lacks even %s, with SSE4.2 and POPCNT\n", isanames[SSE4]);
+    return 1;
+  }
+  unsigned n;
+  for (n = 0; n < NINSTANCES && instances[n].edgebits != edgebits; n++) ;
+  if (n == NINSTANCES) {
+    printf("EDGEBITS %d unsupported; choose one of", edgebits);
+    for (n = 0; n < NINSTANCES; n++)
+      printf(" %d", instances[n].edgebits);
+    printf("\n");
+    return 1;
+  }
+  const char *profile = optionarg(argc, argv, 'P');
+  if (!profile)
+    profile = DEFAULT_PROFILE;
+  const bool tune = optionarg(argc, argv, 'A') != 0; // a flag, its "argument" left alone
+  argc = dropoption(argc, argv, 'P');
+  argc = dropoption(argc, argv, 'A', false);
+  if (tune) {
+    if (!*profile) {
+      printf("-A needs a profile to write, other than none with -P \"\"\n");
+      return 1;
+    }
+    return autotune(argc, argv, instances[n], i, profile);
+  }
+
+  tuning t = { STD, 0 };
+  bool tuned = *profile && readprofile(profile, instances[n], i, &t);
+  if ((arg = optionarg(argc, argv, 'l'))) {
+    int l = lookup(arg, layoutnames, NLAYOUTS);
+    if (l == NLAYOUTS || !instances[n].main[i][l]) {
+      printf("Layout %s unknown or not built for %s\n", arg, isanames[i]);
+      return 1;
+    }
+    // a profiled compression round only goes with its layout
+    tuned = tuned && l == t.layout;
+    t.layout = l;
+  }
+  if (tuned && t.compressround && !optionarg(argc, argv, 'c')) {
+    char cr[16];
+    snprintf(cr, sizeof(cr), "%d", t.compressround);
+    std::vector<char *> args(argv, argv + argc + 1); // including final 0
+    args.insert(args.begin() + 1, (char *)"-c");
+    args.insert(args.begin() + 2, cr);
+    return instances[n].main[i][t.layout](argc + 2, args.data());
+  }
+  return instances[n].main[i][t.layout](argc, argv);
+}
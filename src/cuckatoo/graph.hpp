@@ -31,11 +31,13 @@ public:
   u32 MAXSOLS;
   proof *sols;
   u32 nsols;
+  bool quiet; // about the cycles found, as for solvers sharing stdout
 
   graph(word_t maxedges, word_t maxnodes, u32 maxsols) : visited(maxnodes) {
     MAXEDGES = maxedges;
     MAXNODES = maxnodes;
     MAXSOLS = maxsols;
+    quiet = false;
     adjlist = new word_t[2*MAXNODES]; // index into links array
     links   = new link[2*MAXEDGES];
     compressu = compressv = 0;
@@ -56,12 +58,13 @@ public:
     MAXEDGES = maxedges;
     MAXNODES = maxnodes;
     MAXSOLS = maxsols;
+    quiet = false;
     adjlist = new word_t[2*MAXNODES]; // index into links array
     links   = new link[2*MAXEDGES];
     compressu = new compressor<word_t>(EDGEBITS, compressbits);
     compressv = new compressor<word_t>(EDGEBITS, compressbits);
     sharedmem = false;
-    sols    = new  proof[MAXSOLS];
+    sols    = new  proof[MAXSOLS+1]; // extra one for current path
     visited.clear();
   }
 
@@ -69,11 +72,12 @@ public:
     MAXEDGES = maxedges;
     MAXNODES = maxnodes;
     MAXSOLS = maxsols;
+    quiet = false;
     adjlist = new (bytes) word_t[2*MAXNODES]; // index into links array
     links   = new (bytes += sizeof(word_t[2*MAXNODES])) link[2*MAXEDGES];
     compressu = compressv = 0;
     sharedmem = true;
-    sols    = new  proof[MAXSOLS];
+    sols    = new  proof[MAXSOLS+1]; // extra one for current path
     visited.clear();
   }
 
@@ -81,12 +85,13 @@ public:
     MAXEDGES = maxedges;
     MAXNODES = maxnodes;
     MAXSOLS = maxsols;
+    quiet = false;
     adjlist = new (bytes) word_t[2*MAXNODES]; // index into links array
     links   = new (bytes += sizeof(word_t[2*MAXNODES])) link[2*MAXEDGES];
     compressu = new compressor<word_t>(EDGEBITS, compressbits, bytes += sizeof(link[2*MAXEDGES]));
     compressv = new compressor<word_t>(EDGEBITS, compressbits, bytes + compressu->bytes());
     sharedmem = true;
-    sols    = new  proof[MAXSOLS];
+    sols    = new  proof[MAXSOLS+1]; // extra one for current path
     visited.clear();
   }
 
@@ -117,7 +122,10 @@ public:
     if (visited.test(u >> 1))
       return;
     if ((u ^ 1) == dest) {
-      printf("  %d-cycle found\n", len);
+#ifndef LIBCUCKATOO
+      if (!quiet)
+        printf("  %d-cycle found\n", len);
+#endif
       if (len == PROOFSIZE && nsols < MAXSOLS) {
         qsort(sols[nsols++], PROOFSIZE, sizeof(word_t), nonce_cmp);
         memcpy(sols[nsols], sols[nsols-1], sizeof(sols[0]));
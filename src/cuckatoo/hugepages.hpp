@@ -0,0 +1,91 @@
+// Cuckatoo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2019 John Tromp
+
+#ifndef INCLUDE_HUGEPAGES_HPP
+#define INCLUDE_HUGEPAGES_HPP
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <new>
+
+// explicit huge page sizes for MAP_HUGETLB, as in <linux/mman.h>
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+// one large anonymous mapping, on the biggest pages the system will give us.
+// the bucket arrays are written all over, and at several GB take a DTLB miss
+// on nearly every access with 4KB pages. we try reserved 1GB and 2MB pages
+// first, which need vm.nr_hugepages or the like to be set, then fall back to
+// asking for transparent huge pages, and finally to plain malloc'ed memory
+class hugepages {
+public:
+  enum kind_t { PLAIN, TRANSPARENT, HUGE2M, HUGE1G };
+
+  void *ptr;
+  uint64_t bytes;    // size actually mapped, rounded up to pagesize
+  uint64_t pagesize; // granularity at which memory needs touching
+  kind_t kind;
+  bool mapped;       // by mmap rather than malloc
+
+  hugepages(const uint64_t size) {
+    ptr = 0;
+    mapped = false;
+#ifdef MAP_HUGETLB
+    if (size >= 1ULL << 30 && map(size, 1ULL << 30, MAP_HUGETLB | MAP_HUGE_1GB))
+      kind = HUGE1G;
+    else if (map(size, 1ULL << 21, MAP_HUGETLB | MAP_HUGE_2MB))
+      kind = HUGE2M;
+    else
+#endif
+#ifdef MADV_HUGEPAGE
+    if (map(size, 1ULL << 21, 0)) {
+      kind = madvise(ptr, bytes, MADV_HUGEPAGE) == 0 ? TRANSPARENT : PLAIN;
+      pagesize = 4096;
+    } else
+#endif
+    {
+      kind = PLAIN;
+      bytes = size;
+      pagesize = 4096;
+      ptr = malloc(size);
+    }
+    if (!ptr)
+      throw std::bad_alloc();
+  }
+  ~hugepages() {
+    if (mapped)
+      munmap(ptr, bytes);
+    else free(ptr);
+  }
+  const char *name() const {
+    switch (kind) {
+      case HUGE1G:      return "1GB";
+      case HUGE2M:      return "2MB";
+      case TRANSPARENT: return "transparent huge";
+      default:          return "4KB";
+    }
+  }
+
+private:
+  bool map(const uint64_t size, const uint64_t align, const int flags) {
+    uint64_t len = (size + align-1) & -align;
+    void *p = mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    if (p == MAP_FAILED)
+      return false;
+    ptr = p;
+    mapped = true;
+    bytes = len;
+    pagesize = align;
+    return true;
+  }
+};
+
+#endif // ifdef INCLUDE_HUGEPAGES_HPP
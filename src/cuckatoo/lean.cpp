@@ -4,14 +4,73 @@
 #include "lean.hpp"
 #include <unistd.h>
 #include <sys/time.h>
+#ifdef __linux__
+#include <sys/sysinfo.h>
+#endif
 
 // arbitrary length of header hashed into siphash key
 #define HEADERLEN 80
 
+// most partition bits tried in fitting available memory, or allowed with -p
+#define MAXPARTBITS 6
+// but no more than leave cycle finding room for 2^MINCGBITS edges, some 50
+// times PROOFSIZE, and enough for what survived 100 nonces at 19 bits and -p 0
+#define MINCGBITS 11
+
+// read a single number from file name, or return 0
+u64 readnumber(const char *name) {
+  unsigned long long n = 0;
+  FILE *f = fopen(name, "r");
+  if (f) {
+    if (fscanf(f, "%llu", &n) != 1) // as for a cgroup v2 limit of "max"
+      n = 0;
+    fclose(f);
+  }
+  return n;
+}
+
+// the kernel's estimate of memory available without swapping, which unlike
+// free memory counts the page cache it can reclaim, or 0 if unknown
+u64 meminfoavailable() {
+  unsigned long long kb = 0;
+  char line[256];
+  FILE *f = fopen("/proc/meminfo", "r");
+  if (f) {
+    while (fgets(line, sizeof(line), f) && sscanf(line, "MemAvailable: %llu kB", &kb) != 1) ;
+    fclose(f);
+  }
+  return (u64)kb << 10;
+}
+
+// available memory, less any beyond our cgroup's limit, or 0 if unknown
+u64 availablememory() {
+  u64 avail = 0;
+#ifdef __linux__
+  avail = meminfoavailable();
+  struct sysinfo si;
+  if (!avail && sysinfo(&si) == 0) // kernels before 3.14
+    avail = ((u64)si.freeram + si.bufferram) * si.mem_unit;
+  static const char *cgroups[][2] = {
+    { "/sys/fs/cgroup/memory.max", "/sys/fs/cgroup/memory.current" }, // v2
+    { "/sys/fs/cgroup/memory/memory.limit_in_bytes", "/sys/fs/cgroup/memory/memory.usage_in_bytes" }, // v1
+  };
+  for (u32 i = 0; i < sizeof(cgroups) / sizeof(cgroups[0]); i++) {
+    u64 limit = readnumber(cgroups[i][0]), usage = readnumber(cgroups[i][1]);
+    if (limit) {
+      u64 left = limit > usage ? limit - usage : 0;
+      if (!avail || left < avail)
+        avail = left;
+    }
+  }
+#endif
+  return avail;
+}
+
 
 int main(int argc, char **argv) {
   int nthreads = 1;
-  int ntrims   = 2 * (PART_BITS+3) * (PART_BITS+4);
+  int ntrims   = -1;
+  int partbits = -1;
   int nonce = 0;
   int range = 1;
   char header[HEADERLEN];
@@ -19,9 +78,11 @@ int main(int argc, char **argv) {
   struct timeval time0, time1;
   u32 timems;
   int c;
+  // as cg holds NEDGES >> (partbits+8) edges
+  const int maxpartbits = EDGEBITS-8-MINCGBITS < 0 ? 0 : EDGEBITS-8-MINCGBITS < MAXPARTBITS ? EDGEBITS-8-MINCGBITS : MAXPARTBITS;
 
   memset(header, 0, sizeof(header));
-  while ((c = getopt (argc, argv, "h:m:n:r:t:")) != -1) {
+  while ((c = getopt (argc, argv, "h:m:n:p:r:t:")) != -1) {
     switch (c) {
       case 'h':
         len = strlen(optarg);
@@ -31,6 +92,14 @@ int main(int argc, char **argv) {
       case 'n':
         nonce = atoi(optarg);
         break;
+      case 'p':
+        partbits = atoi(optarg);
+        if (partbits < 0 || partbits > maxpartbits) {
+          printf("Partition bits %d must be in 0..%d, for cycle finding to hold %d of %d edges\n",
+             partbits, maxpartbits, (int)(NEDGES >> (maxpartbits+8)), (int)NEDGES);
+          exit(1);
+        }
+        break;
       case 'r':
         range = atoi(optarg);
         break;
@@ -42,15 +111,23 @@ int main(int argc, char **argv) {
         break;
     }
   }
+  u64 avail = availablememory();
+  if (partbits < 0) { // fewest partitions that fit, or else the most tried
+    for (partbits = 0; partbits < maxpartbits && avail && cuckoo_ctx::bytes(nthreads, partbits) > avail; partbits++) ;
+    if (avail)
+      printf("Picked %d partition bits to fit %dMB of available memory\n", partbits, (int)(avail >> 20));
+  }
+  if (ntrims < 0)
+    ntrims = 2 * (partbits+3) * (partbits+4);
   printf("Looking for %d-cycle on cuckatoo%d(\"%s\",%d", PROOFSIZE, EDGEBITS, header, nonce);
   if (range > 1)
     printf("-%d", nonce+range-1);
-  printf(") with trimming to %d bits, %d threads\n", EDGEBITS-IDXSHIFT, nthreads);
+  printf(") with trimming to %d bits, %d threads\n", EDGEBITS-(partbits+8), nthreads);
 
   u64 EdgeBytes = NEDGES/8;
   int EdgeUnit;
   for (EdgeUnit=0; EdgeBytes >= 1024; EdgeBytes>>=10,EdgeUnit++) ;
-  u64 NodeBytes = (NEDGES >> PART_BITS)/8;
+  u64 NodeBytes = (NEDGES >> partbits)/8;
   int NodeUnit;
   for (NodeUnit=0; NodeBytes >= 1024; NodeBytes>>=10,NodeUnit++) ;
   printf("Using %d%cB edge and %d%cB node memory, and %d-way siphash\n",
@@ -58,7 +135,17 @@ int main(int argc, char **argv) {
 
   thread_ctx *threads = new thread_ctx[nthreads];
   assert(threads);
-  cuckoo_ctx ctx(nthreads, ntrims, MAXSOLS);
+  cuckoo_ctx ctx(nthreads, ntrims, MAXSOLS, partbits);
+#ifdef SHARDED
+  printf("Sharding node memory over %d threads, with %dkB of queues\n",
+     nthreads, (int)((u64)nthreads * nthreads * sizeof(nodequeue) >> 10));
+#endif
+  if (BINBITS)
+    printf("Binning into %d slices of %dkB node memory, with %dkB of bins\n",
+       NBINS, (int)(((u64)1 << ctx.slicebits) / 8 >> 10), (int)(nodebins::bytes(nthreads, ctx.slicebits) >> 10));
+  if (COMPACTSHIFT)
+    printf("Compacting at %d edges alive, into %dkB of edge memory\n",
+       (int)(NEDGES >> COMPACTSHIFT), (int)((NEDGES >> COMPACTSHIFT) * sizeof(compactedge) >> 10));
 
   u32 sumnsols = 0;
   for (int r = 0; r < range; r++) {
@@ -4,7 +4,7 @@
 // http://da-data.blogspot.com/2014/03/a-public-review-of-cuckoo-cycle.html
 // The use of prefetching was suggested by Alexander Peslyak (aka Solar Designer)
 
-#ifdef ATOMIC
+#if defined(ATOMIC) || defined(SHARDED)
 #include <atomic>
 #endif
 #include "cuckatoo.h"
@@ -12,6 +12,11 @@
 #include "graph.hpp"
 #include <stdio.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #ifdef __APPLE__
 #include "../apple/osx_barrier.h"
 #endif
@@ -36,15 +41,6 @@ typedef u64 au64;
 const static u32 NODEBITS = EDGEBITS + 1;
 const static word_t NODEMASK = (EDGEMASK << 1) | (word_t)1;
 
-#ifndef PART_BITS
-// #bits used to partition edge set processing to save memory
-// a value of 0 does no partitioning and is fastest
-// a value of 1 partitions in two, making twice_set the
-// same size as shrinkingset at about 33% slowdown
-// higher values are not that interesting
-#define PART_BITS 0
-#endif
-
 #ifndef NPREFETCH
 // how many prefetches to queue up
 // before accessing the memory
@@ -52,16 +48,169 @@ const static word_t NODEMASK = (EDGEMASK << 1) | (word_t)1;
 #define NPREFETCH 32
 #endif
 
-#ifndef IDXSHIFT
-// minimum shift that allows cycle finding data to fit in node bitmap space
-// allowing them to share the same memory
-#define IDXSHIFT (PART_BITS + 8)
+#ifndef COMPACTSHIFT
+// once at most NEDGES >> COMPACTSHIFT edges are alive, rounds no longer
+// scan the whole alive bitmap and rehash every survivor, but go through
+// an array of survivors with cached endpoints, of 12 bytes per edge.
+// a value of 0 does no compaction
+#define COMPACTSHIFT 8
+#endif
+
+// an edge surviving into compacted rounds
+typedef struct {
+  u32 nonce;
+  u32 uv[2]; // endpoints, as masked siphash outputs
+} compactedge;
+
+#ifndef BINBITS
+// #bits used to split nonleaf into slices, each with its own bin of
+// pending updates per thread, in place of one prefetched random access
+// per edge. a bin is applied to its slice only once full, or at the end
+// of a pass, so a slice comes into cache once for many updates to each
+// of its lines. a value of 0 does no binning
+#define BINBITS 0
 #endif
-#define MAXEDGES (NEDGES >> IDXSHIFT)
 
-const static word_t PART_MASK = (1 << PART_BITS) - 1;
-const static word_t NONPART_BITS = EDGEBITS - PART_BITS;
-const static word_t NONPART_MASK = ((word_t)1 << NONPART_BITS) - 1;
+#ifndef BINREUSE
+// updates per cache line of its slice that a bin holds before it's
+// applied, a multiple of 8. bins then take BINREUSE/8 times the memory
+// of nonleaf, per thread, far more than stays in cache
+#define BINREUSE 8
+#endif
+
+const static u32 NBINS = 1 << BINBITS;
+
+// per-thread bins of nonleaf updates, each entry an edge index in the
+// high 32 bits above a node within the bin's slice. as the bins are too
+// big to stay in cache, entries are staged a cache line per bin, and
+// full lines written out with streaming stores, sparing the read of each
+// line that a plain store would miss on
+class nodebins {
+public:
+  const u32 binsize;
+  u64 *entries;
+  u64 *lines; // of 8 entries, staging the last of each bin
+  u32 *fill;  // of each bin, including its staged entries
+#ifdef ATOMIC
+  std::atomic<bool> *busy; // per slice, while a thread applies a bin to it
+#endif
+
+  nodebins(const u32 nthreads, const u32 slicebits) : binsize(size(slicebits)) {
+    entries = lines = 0;
+    fill = 0;
+#ifdef ATOMIC
+    busy = 0;
+#endif
+    if (!BINBITS)
+      return;
+    int err = posix_memalign((void **)&entries, 64, (u64)nthreads * NBINS * (binsize + 8) * sizeof(u64));
+    assert(err == 0);
+    err = posix_memalign((void **)&lines, 64, (u64)nthreads * NBINS * 8 * sizeof(u64));
+    assert(err == 0);
+    fill = new u32[nthreads * NBINS]();
+#ifdef ATOMIC
+    busy = new std::atomic<bool>[NBINS];
+    for (u32 b = 0; b < NBINS; b++)
+      busy[b] = false;
+#endif
+  }
+  ~nodebins() {
+    free(entries);
+    free(lines);
+    delete[] fill;
+#ifdef ATOMIC
+    delete[] busy;
+#endif
+  }
+  // for sole access to the nonleaf words of slice b, so that setting
+  // bits takes one atomic exchange per bin rather than one per update
+  void lock(const u32 b) {
+#ifdef ATOMIC
+    while (busy[b].exchange(true, std::memory_order_acquire)) ;
+#endif
+  }
+  void unlock(const u32 b) {
+#ifdef ATOMIC
+    busy[b].store(false, std::memory_order_release);
+#endif
+  }
+  // a line apart beyond binsize, so that bins don't all start in the same cache set
+  u64 *bin(const u32 id, const u32 b) const {
+    return entries + ((u64)id * NBINS + b) * (binsize + 8);
+  }
+  u64 *line(const u32 id, const u32 b) const {
+    return lines + ((u64)id * NBINS + b) * 8;
+  }
+  // write out a full staged line, ending at entry n of the bin
+  void stream(const u32 id, const u32 b, const u32 n) {
+    u64 *dst = bin(id, b) + n - 8, *src = line(id, b);
+#ifdef __SSE2__
+    for (u32 i = 0; i < 8; i += 2)
+      _mm_stream_si128((__m128i *)(dst + i), _mm_load_si128((__m128i *)(src + i)));
+#else
+    memcpy(dst, src, 8 * sizeof(u64));
+#endif
+  }
+  // of a bin for slices of 2^slicebits nodes, in 2^(slicebits-9) cache lines
+  static u32 size(const u32 slicebits) {
+    return slicebits > 9 ? BINREUSE << (slicebits - 9) : BINREUSE;
+  }
+  static u64 bytes(const u32 nthreads, const u32 slicebits) {
+    return BINBITS ? (u64)nthreads * NBINS * (size(slicebits) + 16) * sizeof(u64) : 0;
+  }
+};
+
+#ifdef SHARDED
+// each thread owns a disjoint range of nonleaf words, and sets bits in no
+// others, but hands their node offsets to the owner through a queue, so
+// nonleaf needs no atomic updates and no cache line goes back and forth
+// between the threads setting its bits. kill_leaf_edges only reads nonleaf
+static_assert(!BINBITS, "SHARDED does its own binning");
+
+#ifndef QUEUESIZE
+// node offsets a queue holds; must be a power of 2
+#define QUEUESIZE 1024
+#endif
+
+// single producer single consumer ring of node offsets
+class nodequeue {
+public:
+  std::atomic<u32> head; // advanced by consumer
+  char pad0[64 - sizeof(std::atomic<u32>)];
+  std::atomic<u32> tail; // advanced by producer
+  u32 headseen;          // producer's stale copy of head
+  char pad1[64 - sizeof(std::atomic<u32>) - sizeof(u32)];
+  u32 offsets[QUEUESIZE];
+
+  nodequeue() : head(0), tail(0), headseen(0) { }
+  bool push(const u32 off) {
+    const u32 t = tail.load(std::memory_order_relaxed);
+    if (t - headseen == QUEUESIZE) {
+      headseen = head.load(std::memory_order_acquire);
+      if (t - headseen == QUEUESIZE)
+        return false;
+    }
+    offsets[t % QUEUESIZE] = off;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+  template <class F> u32 drain(F apply) {
+    const u32 h = head.load(std::memory_order_relaxed);
+    const u32 t = tail.load(std::memory_order_acquire);
+    for (u32 i = h; i != t; i++)
+      apply(offsets[i % QUEUESIZE]);
+    head.store(t, std::memory_order_release);
+    return t - h;
+  }
+};
+#endif
+
+// room needed by shrinkingset::alivenonces
+const static u32 NONCEBUF = 64 + 16;
+
+// bits of alive edges summed up per entry of shrinkingset's rank directory
+const static u32 RANKBITS = 512;
+const static word_t NRANKS = NEDGES / RANKBITS; // assumes EDGEBITS >= 9
 
 // set that starts out full and gets reset by threads on disjoint words
 class shrinkingset {
@@ -69,13 +218,16 @@ public:
   bitmap<u64> bmap;
   u64 *cnt;
   u32 nthreads;
+  u32 *ranks; // number of alive edges before each RANKBITS, by buildranks
 
   shrinkingset(const u32 nt) : bmap(NEDGES) {
     cnt  = new u64[nt];
     nthreads = nt;
+    ranks = new u32[NRANKS];
   }
   ~shrinkingset() {
     delete[] cnt;
+    delete[] ranks;
   }
   void clear() {
     bmap.clear();
@@ -95,16 +247,106 @@ public:
   bool test(word_t n) const {
     return !bmap.test(n);
   }
+  void prefetch(word_t n) const {
+    bmap.prefetch(n);
+  }
   u64 block(word_t n) const {
     return ~bmap.block(n);
   }
+  // write the nonces alive among the 64 from start densely to nonces,
+  // returning their number. this avoids a serial chain of ffs and shift
+  // per nonce, and may write up to NONCEBUF entries
+  u32 alivenonces(const word_t start, u32 *nonces) const {
+    const u64 alive64 = block(start);
+    u32 n = 0;
+#if defined(__AVX512F__)
+    const __m512i iota = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    for (u32 i = 0; i < 64 && alive64 >> i; i += 16) {
+      const __mmask16 mask = alive64 >> i;
+      const __m512i idx = _mm512_add_epi32(_mm512_set1_epi32(start + i), iota);
+      _mm512_storeu_si512(nonces + n, _mm512_maskz_compress_epi32(mask, idx));
+      n += __builtin_popcount(mask);
+    }
+#elif defined(__AVX2__) && defined(__BMI2__)
+    for (u32 i = 0; i < 64 && alive64 >> i; i += 8) {
+      const u32 byte = (alive64 >> i) & 0xff;
+      // positions of set bits, one per byte, by selecting from 0..7
+      const u64 pos = _pext_u64(0x0706050403020100ULL, _pdep_u64(byte, 0x0101010101010101ULL) * 0xff);
+      const __m256i idx = _mm256_add_epi32(_mm256_set1_epi32(start + i), _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(pos)));
+      _mm256_storeu_si256((__m256i *)(nonces + n), idx);
+      n += __builtin_popcount(byte);
+    }
+#else
+    for (u64 a = alive64; a; a &= a - 1)
+      nonces[n++] = start + __builtin_ctzll(a);
+#endif
+    return n;
+  }
+  // once trimming is done, for select
+  void buildranks() {
+    u32 sum = 0;
+    for (word_t r = 0; r < NRANKS; r++) {
+      ranks[r] = sum;
+      for (u32 i = 0; i < RANKBITS; i += 64)
+        sum += __builtin_popcountll(block(r * RANKBITS + i));
+    }
+  }
+  // nonce of the alive edge preceded by rank others, by binary search
+  // of ranks and a scan of at most RANKBITS. that is O(log(NRANKS)) per
+  // nonce; a sampled select index would make it O(1), but costs memory
+  // and a second pass in buildranks for only PROOFSIZE lookups a cycle
+  word_t select(u32 rank) const {
+    word_t lo = 0, hi = NRANKS;
+    while (hi - lo > 1) {
+      const word_t mid = (lo + hi) / 2;
+      if (ranks[mid] <= rank)
+        lo = mid;
+      else hi = mid;
+    }
+    rank -= ranks[lo];
+    for (word_t n = lo * RANKBITS; ; n += 64) {
+      u64 alive64 = block(n);
+      const u32 nalive = __builtin_popcountll(alive64);
+      if (rank < nalive) {
+#ifdef __BMI2__
+        return n + __builtin_ctzll(_pdep_u64((u64)1 << rank, alive64));
+#else
+        for (; rank; rank--)
+          alive64 &= alive64 - 1;
+        return n + __builtin_ctzll(alive64);
+#endif
+      }
+      rank -= nalive;
+    }
+  }
 };
 
 class cuckoo_ctx {
 public:
   siphash_keys sip_keys;
+  // #bits used to partition edge set processing to save memory
+  // a value of 0 does no partitioning and is fastest
+  // a value of 1 partitions in two, making twice_set the
+  // same size as shrinkingset at about 33% slowdown
+  // higher values are not that interesting
+  const u32 partbits;
+  const word_t partmask;
+  const u32 nonpartbits;
+  const word_t nonpartmask;
+  // minimum shift that allows cycle finding data to fit in node bitmap space
+  // allowing them to share the same memory
+  const u32 idxshift;
+  const u32 slicebits; // of each bin's slice of nonleaf
   shrinkingset alive;
   bitmap<word_t> nonleaf;
+  nodebins bins;
+  compactedge *compact; // each thread's survivors, in order of thread id
+  u32 *compactstart;
+  u32 *ncompact;
+#ifdef SHARDED
+  nodequeue *queues; // from thread p to thread q at queues[p * nthreads + q]
+  std::atomic<u32> nproduced;
+#endif
   graph<word_t> cg;
   u32 nonce;
   proof *sols;
@@ -113,16 +355,39 @@ public:
   u32 ntrims;
   pthread_barrier_t barry;
 
-  cuckoo_ctx(u32 n_threads, u32 n_trims, u32 max_sols) : alive(n_threads), nonleaf(NEDGES >> PART_BITS),
-      cg(MAXEDGES, MAXEDGES, max_sols, IDXSHIFT, (char *)nonleaf.bits) {
+  cuckoo_ctx(u32 n_threads, u32 n_trims, u32 max_sols, u32 part_bits) : partbits(part_bits),
+      partmask((1 << part_bits) - 1), nonpartbits(EDGEBITS - part_bits),
+      nonpartmask(((word_t)1 << nonpartbits) - 1), idxshift(part_bits + 8),
+      slicebits(nonpartbits - BINBITS), alive(n_threads), nonleaf(NEDGES >> part_bits), bins(n_threads, slicebits),
+      cg(NEDGES >> idxshift, NEDGES >> idxshift, max_sols, idxshift, (char *)nonleaf.bits) {
     printf("cg.bytes %llu NEDGES/8 %llu\n", cg.bytes(), NEDGES/8);
-    assert(cg.bytes() <= NEDGES/8); // check that graph cg can fit in share nonleaf's memory
+    assert(cg.bytes() <= (NEDGES >> partbits)/8); // check that graph cg can fit in share nonleaf's memory
+    assert(!BINBITS || slicebits >= 9); // slices of whole lines, sharing no nonleaf word
     nthreads = n_threads;
     ntrims = n_trims;
     int err = pthread_barrier_init(&barry, NULL, nthreads);
     assert(err == 0);
     sols = new proof[max_sols];
     nsols = 0;
+    compact = COMPACTSHIFT ? new compactedge[NEDGES >> COMPACTSHIFT] : 0;
+    compactstart = new u32[nthreads];
+    ncompact = new u32[nthreads];
+#ifdef SHARDED
+    queues = new nodequeue[nthreads * nthreads];
+    nproduced = 0;
+#endif
+  }
+  // memory taken by a cuckoo_ctx, for picking the fewest part_bits that fit
+  static u64 bytes(const u32 n_threads, const u32 part_bits) {
+    u64 total = NEDGES/8 + (NEDGES >> part_bits)/8; // alive and nonleaf
+    total += NRANKS * sizeof(u32);
+    if (COMPACTSHIFT)
+      total += (NEDGES >> COMPACTSHIFT) * sizeof(compactedge);
+    total += nodebins::bytes(n_threads, EDGEBITS - part_bits - BINBITS);
+#ifdef SHARDED
+    total += (u64)n_threads * n_threads * sizeof(nodequeue);
+#endif
+    return total;
   }
   void setheadernonce(char* headernonce, const u32 len, const u32 nce) {
     nonce = nce;
@@ -133,42 +398,296 @@ public:
   }
   ~cuckoo_ctx() {
     delete[] sols;
+    delete[] compact;
+    delete[] compactstart;
+    delete[] ncompact;
+#ifdef SHARDED
+    delete[] queues;
+#endif
   }
   void prefetch(const u64 *hashes, const u32 part) const {
     for (u32 i=0; i < NSIPHASH; i++) {
       u64 u = hashes[i] & EDGEMASK;
-      if ((u >> NONPART_BITS) == part) {
-        nonleaf.prefetch(u & NONPART_MASK);
+      if ((u >> nonpartbits) == part) {
+        nonleaf.prefetch(u & nonpartmask);
       }
     }
   }
   void node_deg(const u64 *hashes, const u32 nsiphash, const u32 part) {
     for (u32 i=0; i < nsiphash; i++) {
       u64 u = hashes[i] & EDGEMASK;
-      if ((u >> NONPART_BITS) == part) {
-        nonleaf.set(u & NONPART_MASK);
+      if ((u >> nonpartbits) == part) {
+        nonleaf.set(u & nonpartmask);
       }
     }
   }
   void kill(const u64 *hashes, const u64 *indices, const u32 nsiphash, const u32 part, const u32 id) {
     for (u32 i=0; i < nsiphash; i++) {
       u64 u = hashes[i] & EDGEMASK;
-      if ((u >> NONPART_BITS) == part && !nonleaf.test((u & NONPART_MASK) ^ 1)) {
+      if ((u >> nonpartbits) == part && !nonleaf.test((u & nonpartmask) ^ 1)) {
         alive.reset(indices[i]/2, id);
       }
     }
   }
+  void applybin(const u64 *bin, const u32 n, const u32 id, const bool kill) {
+    if (kill) {
+      for (u32 i=0; i < n; i++) {
+        if (i + NPREFETCH < n) // edges from all over, unlike their nodes
+          alive.prefetch(bin[i + NPREFETCH] >> 32);
+        if (!nonleaf.test((u32)bin[i] ^ 1)) {
+          alive.reset(bin[i] >> 32, id);
+        }
+      }
+    } else {
+      for (u32 i=0; i < n; i++) {
+        nonleaf.setsole((u32)bin[i]);
+      }
+    }
+  }
+  void binedges(const u64 *hashes, const u64 *indices, const u32 nsiphash, const u32 part, const u32 id, const bool kill) {
+    for (u32 i=0; i < nsiphash; i++) {
+      u64 u = hashes[i] & EDGEMASK;
+      if ((u >> nonpartbits) == part) {
+        const u32 b = (u & nonpartmask) >> slicebits;
+        u32 &fill = bins.fill[id * NBINS + b];
+        bins.line(id, b)[fill % 8] = (indices[i]/2) << 32 | (u & nonpartmask);
+        if (++fill % 8 == 0) {
+          bins.stream(id, b, fill);
+          if (fill == bins.binsize)
+            flushbin(id, b, kill);
+        }
+      }
+    }
+  }
+  // apply a bin to its slice, which it updates BINREUSE times per line when full
+  void flushbin(const u32 id, const u32 b, const bool kill) {
+    u32 &fill = bins.fill[id * NBINS + b];
+    if (!kill)
+      bins.lock(b);
+    applybin(bins.bin(id, b), fill & -8, id, kill);
+    applybin(bins.line(id, b), fill % 8, id, kill);
+    if (!kill)
+      bins.unlock(b);
+    fill = 0;
+  }
+  void flushbins(const u32 id, const bool kill) {
+    for (u32 b = 0; b < NBINS; b++)
+      flushbin(id, b, kill);
+  }
+  // count_node_deg or kill_leaf_edges by way of the bins, which are all
+  // flushed before returning, leaving the next barrier to order them
+  void binned(const u32 id, const u32 uorv, const u32 part, const bool kill) {
+    alignas(64) u64 indices[NSIPHASH];
+    alignas(64) u64 hashes[NSIPHASH];
+    alignas(64) u32 nonces[NONCEBUF];
+
+    u32 nidx = 0;
+    for (word_t block = id*64; block < NEDGES; block += nthreads*64) {
+      const u32 nalive = alive.alivenonces(block, nonces);
+      for (u32 i = 0; i < nalive; i++) {
+        const word_t nonce = nonces[i];
+        indices[nidx++] = 2*nonce + uorv;
+        if (nidx == NSIPHASH) {
+          siphash24xN(&sip_keys, indices, hashes);
+          binedges(hashes, indices, NSIPHASH, part, id, kill);
+          nidx = 0;
+        }
+      }
+    }
+    if (nidx) {
+      siphash24xN(&sip_keys, indices, hashes);
+      binedges(hashes, indices, nidx, part, id, kill);
+    }
+    flushbins(id, kill);
+  }
+#ifdef SHARDED
+  // thread owning the nonleaf word of node offset off
+  u32 owner(const word_t off) const {
+    return (u64)(off / nonleaf.BITS_PER_WORD * nonleaf.BITS_PER_WORD) * nthreads >> nonpartbits;
+  }
+  u32 drainqueues(const u32 id) {
+    u32 n = 0;
+    for (u32 p = 0; p < nthreads; p++)
+      n += queues[p * nthreads + id].drain([this](u32 off) { nonleaf.set(off); });
+    return n;
+  }
+  void shard_node_deg(const u64 *hashes, const u32 nsiphash, const u32 part, const u32 id) {
+    for (u32 i=0; i < nsiphash; i++) {
+      u64 u = hashes[i] & EDGEMASK;
+      if ((u >> nonpartbits) == part) {
+        const word_t off = u & nonpartmask;
+        const u32 q = owner(off);
+        if (q == id)
+          nonleaf.set(off);
+        else while (!queues[id * nthreads + q].push(off)) {
+          if (!drainqueues(id)) // so that q, if waiting on us, can make progress
+            sched_yield();
+        }
+      }
+    }
+  }
+  // count_node_deg on owned nonleaf words only. after producing its own
+  // share, each thread keeps draining its queues until all have produced
+  void sharded_node_deg(const u32 id, const u32 uorv, const u32 part) {
+    alignas(64) u64 indices[NSIPHASH];
+    alignas(64) u64 hashes[NSIPHASH];
+    alignas(64) u32 nonces[NONCEBUF];
+
+    if (id == 0 && part == 0)
+      nonleaf.set(0); // as count_node_deg's zeroed hashes do, for kill_leaf_edges' dummies
+    u32 nidx = 0, nblocks = 0;
+    for (word_t block = id*64; block < NEDGES; block += nthreads*64) {
+      const u32 nalive = alive.alivenonces(block, nonces);
+      for (u32 i = 0; i < nalive; i++) {
+        const word_t nonce = nonces[i];
+        indices[nidx++] = 2*nonce + uorv;
+        if (nidx == NSIPHASH) {
+          siphash24xN(&sip_keys, indices, hashes);
+          shard_node_deg(hashes, NSIPHASH, part, id);
+          nidx = 0;
+        }
+      }
+      if (++nblocks % 16 == 0) // now and then, to keep queues from filling
+        drainqueues(id);
+    }
+    if (nidx) {
+      siphash24xN(&sip_keys, indices, hashes);
+      shard_node_deg(hashes, nidx, part, id);
+    }
+    sharded_done(id);
+  }
+  void sharded_done(const u32 id) {
+    nproduced.fetch_add(1, std::memory_order_acq_rel);
+    while (nproduced.load(std::memory_order_acquire) < nthreads) {
+      if (!drainqueues(id))
+        sched_yield(); // to producers, when threads outnumber cores
+    }
+    drainqueues(id);
+  }
+#endif
+  // number of edges alive in this thread's blocks, for compactfill's offsets
+  void compactcount(const u32 id) {
+    u32 n = 0;
+    for (word_t block = id*64; block < NEDGES; block += nthreads*64)
+      n += __builtin_popcountll(alive.block(block));
+    ncompact[id] = n;
+  }
+  // after all threads' compactcount, move this thread's survivors to compact
+  void compactfill(const u32 id) {
+    alignas(64) u64 indices[2][NSIPHASH];
+    alignas(64) u64 hashes[2][NSIPHASH];
+    alignas(64) u32 nonces[NONCEBUF];
+
+    u32 start = 0;
+    for (u32 t = 0; t < id; t++)
+      start += ncompact[t];
+    compactstart[id] = start;
+    compactedge *edges = compact + start;
+    u32 n = 0, nidx = 0;
+    for (word_t block = id*64; block < NEDGES; block += nthreads*64) {
+      const u32 nalive = alive.alivenonces(block, nonces);
+      for (u32 i = 0; i < nalive; i++) {
+        const word_t nonce = nonces[i];
+        indices[0][nidx] = 2*nonce;
+        indices[1][nidx++] = 2*nonce + 1;
+        if (nidx == NSIPHASH) {
+          fillbatch(edges + n, indices, hashes, NSIPHASH);
+          n += NSIPHASH;
+          nidx = 0;
+        }
+      }
+    }
+    fillbatch(edges + n, indices, hashes, nidx);
+    assert(n + nidx == ncompact[id]);
+  }
+  void fillbatch(compactedge *edges, u64 indices[2][NSIPHASH], u64 hashes[2][NSIPHASH], const u32 n) {
+    if (!n)
+      return;
+    for (u32 uorv = 0; uorv < 2; uorv++)
+      siphash24xN(&sip_keys, indices[uorv], hashes[uorv]);
+    for (u32 i = 0; i < n; i++) {
+      edges[i].nonce = indices[0][i] / 2;
+      edges[i].uv[0] = hashes[0][i] & EDGEMASK;
+      edges[i].uv[1] = hashes[1][i] & EDGEMASK;
+    }
+  }
+  // add a batch of edges to cg, in nonce order as nonce recovery expects
+  void addedges(u64 indices[2][NSIPHASH], u64 hashes[2][NSIPHASH], const u32 n) {
+    for (u32 uorv = 0; uorv < 2; uorv++)
+      siphash24xN(&sip_keys, indices[uorv], hashes[uorv]);
+    for (u32 i = 0; i < n; i++)
+      cg.add_compress_edge(hashes[0][i] & EDGEMASK, hashes[1][i] & EDGEMASK);
+  }
+  // count_node_deg over this thread's compacted survivors
+  void count_compact(const u32 id, const u32 uorv, const u32 part) {
+    alignas(64) u64 indices[NSIPHASH];
+    alignas(64) u64 hashes[NSIPHASH];
+
+    const compactedge *edges = compact + compactstart[id];
+    const u32 n = ncompact[id];
+    u32 nidx = 0;
+    for (u32 i = 0; i < n; i++) {
+#if !defined(SHARDED) && !BINBITS
+      if (i + NPREFETCH < n)
+        nonleaf.prefetch(edges[i + NPREFETCH].uv[uorv] & nonpartmask);
+#endif
+      indices[nidx] = 2*edges[i].nonce + uorv;
+      hashes[nidx++] = edges[i].uv[uorv];
+      if (nidx == NSIPHASH) {
+        countbatch(hashes, indices, NSIPHASH, part, id);
+        nidx = 0;
+      }
+    }
+    countbatch(hashes, indices, nidx, part, id);
+#ifdef SHARDED
+    sharded_done(id);
+#else
+    if (BINBITS)
+      flushbins(id, false);
+#endif
+  }
+  void countbatch(const u64 *hashes, const u64 *indices, const u32 n, const u32 part, const u32 id) {
+#ifdef SHARDED
+    shard_node_deg(hashes, n, part, id);
+#else
+    if (BINBITS)
+      binedges(hashes, indices, n, part, id, false);
+    else
+      node_deg(hashes, n, part);
+#endif
+  }
+  // kill_leaf_edges over this thread's compacted survivors, dropping the killed
+  void kill_compact(const u32 id, const u32 uorv, const u32 part) {
+    compactedge *edges = compact + compactstart[id];
+    const u32 n = ncompact[id];
+    u32 nkept = 0;
+    for (u32 i = 0; i < n; i++) {
+      if (i + NPREFETCH < n)
+        nonleaf.prefetch((edges[i + NPREFETCH].uv[uorv] & nonpartmask) ^ 1);
+      const u64 u = edges[i].uv[uorv];
+      if ((u >> nonpartbits) == part && !nonleaf.test((u & nonpartmask) ^ 1))
+        alive.reset(edges[i].nonce, id);
+      else
+        edges[nkept++] = edges[i];
+    }
+    ncompact[id] = nkept;
+  }
   void count_node_deg(const u32 id, const u32 uorv, const u32 part) {
+#ifdef SHARDED
+    return sharded_node_deg(id, uorv, part);
+#endif
+    if (BINBITS)
+      return binned(id, uorv, part, false);
     alignas(64) u64 indices[NSIPHASH];
     alignas(64) u64 hashes[NPREFETCH];
+    alignas(64) u32 nonces[NONCEBUF];
   
     memset(hashes, 0, NPREFETCH * sizeof(u64)); // allow many nonleaf.set(0) to reduce branching
     u32 nidx = 0;
     for (word_t block = id*64; block < NEDGES; block += nthreads*64) {
-      u64 alive64 = alive.block(block);
-      for (word_t nonce = block-1; alive64; ) { // -1 compensates for 1-based ffs
-        u32 ffs = __builtin_ffsll(alive64);
-        nonce += ffs; alive64 >>= ffs;
+      const u32 nalive = alive.alivenonces(block, nonces);
+      for (u32 i = 0; i < nalive; i++) {
+        const word_t nonce = nonces[i];
         indices[nidx++ % NSIPHASH] = 2*nonce + uorv;
         if (nidx % NSIPHASH == 0) {
           node_deg(hashes+nidx-NSIPHASH, NSIPHASH, part);
@@ -176,7 +695,6 @@ public:
           prefetch(hashes+nidx-NSIPHASH, part);
           nidx %= NPREFETCH;
         }
-        if (ffs & 64) break; // can't shift by 64
       }
     }
     node_deg(hashes, NPREFETCH, part);
@@ -186,17 +704,19 @@ public:
     }
   }
   void kill_leaf_edges(const u32 id, const u32 uorv, const u32 part) {
+    if (BINBITS)
+      return binned(id, uorv, part, true);
     alignas(64) u64 indices[NPREFETCH];
     alignas(64) u64 hashes[NPREFETCH];
+    alignas(64) u32 nonces[NONCEBUF];
   
     for (int i=0; i < NPREFETCH; i++)
       hashes[i] = 1; // allow many nonleaf.test(0) to reduce branching
     u32 nidx = 0;
     for (word_t block = id*64; block < NEDGES; block += nthreads*64) {
-      u64 alive64 = alive.block(block);
-      for (word_t nonce = block-1; alive64; ) { // -1 compensates for 1-based ffs
-        u32 ffs = __builtin_ffsll(alive64);
-        nonce += ffs; alive64 >>= ffs;
+      const u32 nalive = alive.alivenonces(block, nonces);
+      for (u32 i = 0; i < nalive; i++) {
+        const word_t nonce = nonces[i];
         indices[nidx++] = 2*nonce + uorv;
         if (nidx % NSIPHASH == 0) {
           siphash24xN(&sip_keys, indices+nidx-NSIPHASH, hashes+nidx-NSIPHASH);
@@ -204,7 +724,6 @@ public:
           nidx %= NPREFETCH;
           kill(hashes+nidx, indices+nidx, NSIPHASH, part, id);
         }
-        if (ffs & 64) break; // can't shift by 64
       }
     }
     const u32 pnsip = nidx & -NSIPHASH;
@@ -238,16 +757,34 @@ void *worker(void *vp) {
   shrinkingset &alive = ctx->alive;
   // if (tp->id == 0) printf("initial size %d\n", NEDGES);
   u32 round;
+  bool compacted = false;
   for (round=1; round < ctx->ntrims; round++) {
+    // all threads see the same count, as none has started killing
+    if (COMPACTSHIFT && !compacted && alive.count() <= NEDGES >> COMPACTSHIFT) {
+      ctx->compactcount(tp->id);
+      barrier(&ctx->barry);
+      ctx->compactfill(tp->id);
+      compacted = true;
+    }
     // if (tp->id == 0) printf("round %2d partition sizes", round);
     for (u32 uorv = 0; uorv < 2; uorv++) {
-      for (u32 part = 0; part <= PART_MASK; part++) {
-        if (tp->id == 0)
+      for (u32 part = 0; part <= ctx->partmask; part++) {
+        if (tp->id == 0) {
           ctx->nonleaf.clear(); // clear all counts
+#ifdef SHARDED
+          ctx->nproduced = 0;
+#endif
+        }
         barrier(&ctx->barry);
-        ctx->count_node_deg(tp->id,uorv,part);
+        if (compacted)
+          ctx->count_compact(tp->id,uorv,part);
+        else
+          ctx->count_node_deg(tp->id,uorv,part);
         barrier(&ctx->barry);
-        ctx->kill_leaf_edges(tp->id,uorv,part);
+        if (compacted)
+          ctx->kill_compact(tp->id,uorv,part);
+        else
+          ctx->kill_leaf_edges(tp->id,uorv,part);
         // if (tp->id == 0) printf(" %c%d %d", "UV"[uorv], part, alive.count());
         barrier(&ctx->barry);
       }
@@ -257,31 +794,33 @@ void *worker(void *vp) {
   if (tp->id != 0)
     pthread_exit(NULL);
   printf("%d trims completed  %d edges left\n", round-1, alive.count());
+  if (alive.count() > ctx->cg.MAXEDGES) { // as may happen with many partitions and few trims
+    printf("too many edges for cycle finding, which holds %d\n", ctx->cg.MAXEDGES);
+    pthread_exit(NULL);
+  }
   ctx->cg.reset();
+  alignas(64) u32 nonces[NONCEBUF];
+  alignas(64) u64 indices[2][NSIPHASH];
+  alignas(64) u64 hashes[2][NSIPHASH];
+  u32 nidx = 0;
   for (word_t block = 0; block < NEDGES; block += 64) {
-    u64 alive64 = alive.block(block);
-    for (word_t nonce = block-1; alive64; ) { // -1 compensates for 1-based ffs
-      u32 ffs = __builtin_ffsll(alive64);
-      nonce += ffs; alive64 >>= ffs;
-      word_t u=sipnode(&ctx->sip_keys, nonce, 0), v=sipnode(&ctx->sip_keys, nonce, 1);
-      ctx->cg.add_compress_edge(u, v);
-      if (ffs & 64) break; // can't shift by 64
+    const u32 nalive = alive.alivenonces(block, nonces);
+    for (u32 i = 0; i < nalive; i++) {
+      indices[0][nidx] = 2*nonces[i];
+      indices[1][nidx++] = 2*nonces[i] + 1;
+      if (nidx == NSIPHASH) {
+        ctx->addedges(indices, hashes, NSIPHASH);
+        nidx = 0;
+      }
     }
   }
+  ctx->addedges(indices, hashes, nidx);
+  // cg numbered edges in nonce order, so an edge's number is its rank
+  if (ctx->cg.nsols)
+    alive.buildranks();
   for (u32 s=0; s < ctx->cg.nsols; s++) {
-    u32 j = 0, nalive = 0;
-    for (word_t block = 0; block < NEDGES; block += 64) {
-      u64 alive64 = alive.block(block);
-      for (word_t nonce = block-1; alive64; ) { // -1 compensates for 1-based ffs
-        u32 ffs = __builtin_ffsll(alive64);
-        nonce += ffs; alive64 >>= ffs;
-        if (j < PROOFSIZE && nalive++ == ctx->cg.sols[s][j]) {
-          ctx->sols[s][j++] = nonce;
-        }
-        if (ffs & 64) break; // can't shift by 64
-      }
-    }
-    assert (j == PROOFSIZE);
+    for (u32 j=0; j < PROOFSIZE; j++)
+      ctx->sols[s][j] = alive.select(ctx->cg.sols[s][j]);
   }
   ctx->nsols = ctx->cg.nsols;
   pthread_exit(NULL);
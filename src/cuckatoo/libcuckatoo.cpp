@@ -0,0 +1,163 @@
+// Cuckatoo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2019 John Tromp
+
+// libcuckatoo's C interface (see libcuckatoo.h) over mean miner instances
+// for many graph sizes and instruction sets, each built from meanlib.cpp
+// into its own namespace, much as dispatch.cpp picks among those with a main.
+// only the std layout is built; the autotuner's pick of others is left to
+// the miner binary
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <vector>
+#include "libcuckatoo.h"
+#include "meanapi.h"
+#include "cpuisa.h"
+
+#define DECLARE_INSTANCE(N,I) namespace libcuckatoo##N##I { extern const meanapi api; }
+#define DECLARE_INSTANCES(N) DECLARE_INSTANCE(N,avx512) DECLARE_INSTANCE(N,avx2) DECLARE_INSTANCE(N,sse4)
+DECLARE_INSTANCES(19)
+DECLARE_INSTANCES(24)
+DECLARE_INSTANCES(25)
+DECLARE_INSTANCES(26)
+DECLARE_INSTANCES(27)
+DECLARE_INSTANCES(28)
+DECLARE_INSTANCES(29)
+DECLARE_INSTANCES(30)
+DECLARE_INSTANCES(31)
+DECLARE_INSTANCES(32)
+
+typedef struct {
+  int edgebits;
+  const meanapi *api[NISAS];
+} instance;
+
+#define INSTANCES(N) {N, {&libcuckatoo##N##avx512::api, &libcuckatoo##N##avx2::api, &libcuckatoo##N##sse4::api}}
+static const instance instances[] = {
+  INSTANCES(19),
+  INSTANCES(24),
+  INSTANCES(25),
+  INSTANCES(26),
+  INSTANCES(27),
+  INSTANCES(28),
+  INSTANCES(29),
+  INSTANCES(30),
+  INSTANCES(31),
+  INSTANCES(32),
+};
+#define NINSTANCES (sizeof(instances) / sizeof(instance))
+
+// proofs kept per graph, as MAXSOLS in mean.hpp
+#define MAXPROOFS 4
+
+struct cuckatoo_ctx {
+  int edgebits;
+  int isa;
+  const meanapi *api;
+  void *solver;
+  char header[CUCKATOO_HEADERLEN];
+  std::vector<uint32_t> nonces; // of each proof
+  std::vector<uint64_t> edges;  // CUCKATOO_PROOFSIZE per proof
+  cuckatoo_stats stats;
+};
+
+cuckatoo_ctx *cuckatoo_create_ntrims(int edgebits, int nthreads, int ntrims) {
+  unsigned n;
+  for (n = 0; n < NINSTANCES && instances[n].edgebits != edgebits; n++) ;
+  const int isa = cpuisa();
+  if (n == NINSTANCES || isa == NISAS || nthreads <= 0 || ntrims < 0)
+    return 0;
+  cuckatoo_ctx *ctx = new (std::nothrow) cuckatoo_ctx;
+  if (!ctx)
+    return 0;
+  ctx->edgebits = edgebits;
+  ctx->isa = isa;
+  ctx->api = instances[n].api[ctx->isa];
+  ctx->solver = ctx->api->create(nthreads, ntrims);
+  if (!ctx->solver) {
+    delete ctx;
+    return 0;
+  }
+  memset(ctx->header, 0, sizeof(ctx->header));
+  memset(&ctx->stats, 0, sizeof(ctx->stats));
+  return ctx;
+}
+
+cuckatoo_ctx *cuckatoo_create(int edgebits, int nthreads) {
+  return cuckatoo_create_ntrims(edgebits, nthreads, 0);
+}
+
+void cuckatoo_destroy(cuckatoo_ctx *ctx) {
+  if (!ctx)
+    return;
+  ctx->api->destroy(ctx->solver);
+  delete ctx;
+}
+
+int cuckatoo_edgebits(const cuckatoo_ctx *ctx) {
+  return ctx->edgebits;
+}
+
+const char *cuckatoo_isa(const cuckatoo_ctx *ctx) {
+  return isanames[ctx->isa];
+}
+
+int cuckatoo_set_header(cuckatoo_ctx *ctx, const void *header, uint32_t len) {
+  if (len > sizeof(ctx->header))
+    return CUCKATOO_EINVAL;
+  memset(ctx->header, 0, sizeof(ctx->header));
+  memcpy(ctx->header, header, len);
+  return 0;
+}
+
+int cuckatoo_solve_range(cuckatoo_ctx *ctx, uint32_t nonce, uint32_t range) {
+  ctx->nonces.clear();
+  ctx->edges.clear();
+  memset(&ctx->stats, 0, sizeof(ctx->stats));
+  ctx->api->uncancel(ctx->solver);
+  uint64_t found[MAXPROOFS * CUCKATOO_PROOFSIZE];
+  try {
+    for (uint32_t r = 0; r < range; r++) {
+      int nproofs = ctx->api->solve(ctx->solver, ctx->header, nonce + r, found, MAXPROOFS, &ctx->stats);
+      if (nproofs == CUCKATOO_ECANCELED)
+        return nproofs;
+      // a failed trim of a single nonce is the caller's to hear of;
+      // within a range it merely yields no proofs
+      if (nproofs < 0 && range == 1)
+        return nproofs;
+      for (int i = 0; i < nproofs; i++) {
+        ctx->nonces.push_back(nonce + r);
+        ctx->edges.insert(ctx->edges.end(), found + i * CUCKATOO_PROOFSIZE, found + (i+1) * CUCKATOO_PROOFSIZE);
+      }
+    }
+  } catch (const std::bad_alloc &) {
+    return CUCKATOO_ENOMEM;
+  }
+  return ctx->nonces.size();
+}
+
+int cuckatoo_solve(cuckatoo_ctx *ctx, uint32_t nonce) {
+  return cuckatoo_solve_range(ctx, nonce, 1);
+}
+
+void cuckatoo_cancel(cuckatoo_ctx *ctx) {
+  ctx->api->cancel(ctx->solver);
+}
+
+int cuckatoo_nproofs(const cuckatoo_ctx *ctx) {
+  return ctx->nonces.size();
+}
+
+int cuckatoo_proof(const cuckatoo_ctx *ctx, int i, uint32_t *nonce, uint64_t *edges) {
+  if (i < 0 || i >= (int)ctx->nonces.size())
+    return CUCKATOO_EINVAL;
+  *nonce = ctx->nonces[i];
+  memcpy(edges, &ctx->edges[i * CUCKATOO_PROOFSIZE], CUCKATOO_PROOFSIZE * sizeof(uint64_t));
+  return 0;
+}
+
+int cuckatoo_stats_get(const cuckatoo_ctx *ctx, cuckatoo_stats *stats) {
+  *stats = ctx->stats;
+  return 0;
+}
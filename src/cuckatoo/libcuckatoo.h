@@ -0,0 +1,84 @@
+// Cuckatoo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2019 John Tromp
+
+// C interface to the mean miner, as built into libcuckatoo.so. a context
+// holds a solver for one graph size and thread count, with all its bucket
+// memory and worker threads, for reuse by any number of solves. nothing is
+// printed, and failures are reported by return value rather than exit()
+//
+//   cuckatoo_ctx *ctx = cuckatoo_create(29, 8);
+//   cuckatoo_set_header(ctx, header, headerlen);
+//   for (int n = cuckatoo_solve_range(ctx, nonce, 16), i = 0; i < n; i++)
+//     cuckatoo_proof(ctx, i, &proofnonce, edges);
+//   cuckatoo_destroy(ctx);
+
+#ifndef INCLUDE_LIBCUCKATOO_H
+#define INCLUDE_LIBCUCKATOO_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// all else in the library is hidden, as it is built with -fvisibility=hidden
+#define CUCKATOO_API __attribute__((visibility("default")))
+
+// length of the cycles sought, and of the edge arrays of proofs
+#define CUCKATOO_PROOFSIZE 42
+// headers are zero padded to this length, with the nonce in the last 4 bytes
+#define CUCKATOO_HEADERLEN 80
+
+// negative results
+#define CUCKATOO_EINVAL    -1 // bad argument, such as an unsupported size
+#define CUCKATOO_ENOMEM    -2 // memory for proofs could not be had
+#define CUCKATOO_EFAILED   -3 // a trim failed its sanity checks; try another nonce
+#define CUCKATOO_ECANCELED -4 // by cuckatoo_cancel
+
+typedef struct cuckatoo_ctx cuckatoo_ctx;
+
+// time spent by the last solve call, summed over its nonces
+typedef struct {
+  uint64_t trimns;       // wall clock time of trimming
+  uint64_t findcyclesns; // of cycle finding, including nonce recovery
+  uint64_t matchns;      // of nonce recovery, by its slowest thread
+  uint64_t edges;        // left after trimming, for cycle finding
+  uint32_t rounds;       // trimming rounds run
+  uint32_t graphs;       // nonces solved
+} cuckatoo_stats;
+
+// a solver for graphs of 2^edgebits edges, on nthreads worker threads
+// and with the fastest instruction set this cpu supports, or 0 on failure,
+// as for a cpu without even SSE4.2
+CUCKATOO_API cuckatoo_ctx *cuckatoo_create(int edgebits, int nthreads);
+// as above, with ntrims (even) trimming rounds rather than the default
+CUCKATOO_API cuckatoo_ctx *cuckatoo_create_ntrims(int edgebits, int nthreads, int ntrims);
+CUCKATOO_API void cuckatoo_destroy(cuckatoo_ctx *ctx);
+
+CUCKATOO_API int cuckatoo_edgebits(const cuckatoo_ctx *ctx);
+// instruction set picked, as in "avx2"
+CUCKATOO_API const char *cuckatoo_isa(const cuckatoo_ctx *ctx);
+
+// header to which solve calls add their nonces, of at most CUCKATOO_HEADERLEN bytes
+CUCKATOO_API int cuckatoo_set_header(cuckatoo_ctx *ctx, const void *header, uint32_t len);
+
+// look for cycles in the graph of nonce, or of nonces nonce up to nonce+range-1,
+// replacing the proofs and stats of the previous call. returns the number of
+// verified proofs found, or a negative error
+CUCKATOO_API int cuckatoo_solve(cuckatoo_ctx *ctx, uint32_t nonce);
+CUCKATOO_API int cuckatoo_solve_range(cuckatoo_ctx *ctx, uint32_t nonce, uint32_t range);
+// from another thread, as when the header went stale, make the solve in
+// progress return CUCKATOO_ECANCELED within a bucket column's work. proofs
+// of the nonces it finished remain, and the context serves the next solve
+CUCKATOO_API void cuckatoo_cancel(cuckatoo_ctx *ctx);
+
+CUCKATOO_API int cuckatoo_nproofs(const cuckatoo_ctx *ctx);
+// the nonce of proof i and its CUCKATOO_PROOFSIZE ascending edges
+CUCKATOO_API int cuckatoo_proof(const cuckatoo_ctx *ctx, int i, uint32_t *nonce, uint64_t *edges);
+CUCKATOO_API int cuckatoo_stats_get(const cuckatoo_ctx *ctx, cuckatoo_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ifdef INCLUDE_LIBCUCKATOO_H
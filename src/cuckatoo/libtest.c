@@ -0,0 +1,105 @@
+// Cuckatoo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2019 John Tromp
+
+// libcuckatoo.so as an embedding miner would use it: one context, reused
+// for every nonce range, solving quietly and reporting from the proofs.
+// with -c, the first solve is cancelled midway, as on a new chain tip
+
+#include "libcuckatoo.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+static unsigned cancelms;
+
+static void *canceller(void *ctx) {
+  usleep(cancelms * 1000);
+  cuckatoo_cancel((cuckatoo_ctx *)ctx);
+  return 0;
+}
+
+static unsigned long msince(const struct timespec *t0) {
+  struct timespec t1;
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  return (t1.tv_sec - t0->tv_sec) * 1000 + (t1.tv_nsec - t0->tv_nsec) / 1000000;
+}
+
+int main(int argc, char **argv) {
+  int edgebits = 19, nthreads = 1, c;
+  unsigned nonce = 0, range = 1, repeats = 1;
+  const char *header = "";
+  while ((c = getopt (argc, argv, "c:e:h:n:r:R:t:")) != -1) {
+    switch (c) {
+      case 'c': // cancel the first solve after this many ms
+        cancelms = atoi(optarg);
+        break;
+      case 'e':
+        edgebits = atoi(optarg);
+        break;
+      case 'h':
+        header = optarg;
+        break;
+      case 'n':
+        nonce = atoi(optarg);
+        break;
+      case 'r':
+        range = atoi(optarg);
+        break;
+      case 'R': // solve the range this many times, with the same context
+        repeats = atoi(optarg);
+        break;
+      case 't':
+        nthreads = atoi(optarg);
+        break;
+    }
+  }
+  cuckatoo_ctx *ctx = cuckatoo_create(edgebits, nthreads);
+  if (!ctx) {
+    printf("No solver for EDGEBITS %d with %d threads\n", edgebits, nthreads);
+    return 1;
+  }
+  printf("Looking for %d-cycle on cuckatoo%d(\"%s\",%u-%u) with %s siphash\n", CUCKATOO_PROOFSIZE, edgebits, header, nonce, nonce+range-1, cuckatoo_isa(ctx));
+  if (cuckatoo_set_header(ctx, header, strlen(header)) < 0) {
+    printf("Header longer than %d bytes\n", CUCKATOO_HEADERLEN);
+    return 1;
+  }
+  if (cancelms) {
+    pthread_t thread;
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pthread_create(&thread, 0, canceller, ctx);
+    int n = cuckatoo_solve_range(ctx, nonce, range);
+    printf("Solve cancelled after %u ms returned %d after %lu ms\n", cancelms, n, msince(&t0));
+    pthread_join(thread, 0);
+    if (n != CUCKATOO_ECANCELED)
+      return 1;
+  }
+  int nproofs = 0;
+  for (unsigned r = 0; r < repeats; r++) {
+    int n = cuckatoo_solve_range(ctx, nonce, range);
+    if (n < 0 || (r && n != nproofs)) {
+      printf("Solve %u found %d proofs\n", r, n);
+      return 1;
+    }
+    nproofs = n;
+    cuckatoo_stats stats;
+    cuckatoo_stats_get(ctx, &stats);
+    printf("Time: trim %lu ms findcycles %lu ms match %lu ms, %u rounds leaving %lu edges in %u graphs\n",
+      stats.trimns/1000000, stats.findcyclesns/1000000, stats.matchns/1000000, stats.rounds, stats.edges, stats.graphs);
+  }
+  for (int i = 0; i < nproofs; i++) {
+    unsigned n;
+    uint64_t edges[CUCKATOO_PROOFSIZE];
+    cuckatoo_proof(ctx, i, &n, edges);
+    printf("Solution for nonce %u", n);
+    for (int j = 0; j < CUCKATOO_PROOFSIZE; j++)
+      printf(" %lx", edges[j]);
+    printf("\n");
+  }
+  printf("%d total solutions\n", nproofs);
+  cuckatoo_destroy(ctx);
+  return 0;
+}
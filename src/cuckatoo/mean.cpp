@@ -8,6 +8,149 @@
 // arbitrary length of header hashed into siphash key
 #define HEADERLEN 80
 
+// the options a solver is set up with after construction, for each group
+// of threads in throughput mode to set up its own
+typedef struct {
+  u32 nthreads;
+  u32 ntrims;
+  bool allrounds;
+  bool showcycle;
+  bool dynamic;
+  bool keepalive;
+  u32 compressround;
+  u32 expandround;
+  u32 slices;
+  double minreduction;
+  u64 targetedges;
+} solveropts;
+
+void setup(solver_ctx &ctx, const solveropts &o) {
+  ctx.trimmer.dynamic = o.dynamic;
+  ctx.trimmer.compressround = COMPRESSROUND ? o.compressround : 0;
+  ctx.trimmer.expandround = o.expandround;
+  ctx.trimmer.slice(o.slices);
+  if (o.keepalive)
+    ctx.trimmer.keepalive();
+  if (o.minreduction >= 0.0 || o.targetedges)
+    ctx.trimmer.adapt(o.minreduction < 0.0 ? 0.0 : o.minreduction, o.targetedges);
+}
+
+// print and verify the solutions of the last solve
+void report(solver_ctx &ctx, const u32 nsols) {
+  siphash_keys *keys = ctx.sipkeys();
+  for (unsigned s = 0; s < nsols; s++) {
+    printf("Solution");
+    word_t *prf = &ctx.sols[s * PROOFSIZE];
+    for (u32 i = 0; i < PROOFSIZE; i++)
+      printf(" %jx", (uintmax_t)prf[i]);
+    printf("\n");
+    int pow_rc = verify(prf, keys);
+    if (pow_rc == POW_OK) {
+      printf("Verified with cyclehash ");
+      unsigned char cyclehash[32];
+      blake2b((void *)cyclehash, sizeof(cyclehash), (const void *)prf, sizeof(proof), 0, 0);
+      for (int i=0; i<32; i++)
+        printf("%02x", cyclehash[i]);
+      printf("\n");
+    } else {
+      printf("FAILED due to %s\n", errstr[pow_rc]);
+    }
+  }
+}
+
+// throughput mode, in which groups of threads each solve whole graphs with
+// a solver of their own, taking the next nonce from a shared dispenser.
+// past a dozen or so threads, a graph's trimming is held back by memory
+// bandwidth and by the barrier after every round; several smaller groups
+// wait less at their barriers and keep more graphs in flight
+typedef struct {
+  solveropts opts;
+  char header[HEADERLEN];
+  u32 nonce;
+  u32 range;
+  std::atomic<u32> next;   // the dispenser, as offset from nonce
+  std::atomic<u32> nsols;
+  FILE *jsonf;
+  pthread_barrier_t start; // of timing, once all solvers are set up
+  pthread_mutex_t output;  // whose lines of a nonce stay together
+} throughput;
+
+typedef struct {
+  throughput *tp;
+  u32 id;
+  u32 graphs;              // solved by this group
+  u64 sharedbytes;         // of its solver
+} group;
+
+void *groupsolver(void *arg) {
+  group &g = *(group *)arg;
+  throughput &tp = *g.tp;
+  solver_ctx ctx(tp.opts.nthreads, tp.opts.ntrims, tp.opts.allrounds, tp.opts.showcycle, false, false);
+  setup(ctx, tp.opts);
+  ctx.quiet = true;
+  g.sharedbytes = ctx.sharedbytes();
+  char header[HEADERLEN];
+  memcpy(header, tp.header, sizeof(header));
+  pthread_barrier_wait(&tp.start);
+  for (u32 r; (r = tp.next.fetch_add(1)) < tp.range; g.graphs++) {
+    const u64 start = phasetimer::now();
+    ctx.setheadernonce(header, sizeof(header), tp.nonce + r);
+    const u32 nsols = ctx.solve();
+    const u32 timems = (phasetimer::now() - start) / 1000000;
+    pthread_mutex_lock(&tp.output);
+    printf("nonce %d by group %d Time: %d ms\n", tp.nonce + r, g.id, timems);
+    report(ctx, nsols);
+    if (tp.jsonf)
+      ctx.stats().json(tp.jsonf, EDGEBITS, tp.nonce + r);
+    pthread_mutex_unlock(&tp.output);
+    tp.nsols += nsols;
+  }
+  return 0;
+}
+
+int solvegroups(const solveropts &opts, const u32 ngroups, const char *header, const u32 nonce, const u32 range, FILE *jsonf) {
+  throughput tp;
+  tp.opts = opts;
+  memcpy(tp.header, header, sizeof(tp.header));
+  tp.nonce = nonce;
+  tp.range = range;
+  tp.next = 0;
+  tp.nsols = 0;
+  tp.jsonf = jsonf;
+  pthread_barrier_init(&tp.start, NULL, ngroups + 1);
+  pthread_mutex_init(&tp.output, NULL);
+  group *groups = new group[ngroups];
+  for (u32 g = 0; g < ngroups; g++) {
+    groups[g].tp = &tp;
+    groups[g].id = g;
+    groups[g].graphs = 0;
+    groups[g].sharedbytes = 0;
+  }
+  pthread_t *threads = new pthread_t[ngroups];
+  for (u32 g = 0; g < ngroups; g++) {
+    int err = pthread_create(&threads[g], NULL, groupsolver, &groups[g]);
+    assert(err == 0);
+  }
+  pthread_barrier_wait(&tp.start);
+  u64 sbytes = groups[0].sharedbytes;
+  int sunit;
+  for (sunit=0; sbytes >= 10240; sbytes>>=10,sunit++) ;
+  printf("Solving in %d groups of %d threads, each with %d%cB bucket memory.\n", ngroups, opts.nthreads, (u32)sbytes, " KMGT"[sunit]);
+  const u64 start = phasetimer::now();
+  for (u32 g = 0; g < ngroups; g++)
+    pthread_join(threads[g], NULL);
+  const double secs = (phasetimer::now() - start) / 1e9;
+  for (u32 g = 0; g < ngroups; g++)
+    printf("group %d solved %d graphs\n", g, groups[g].graphs);
+  printf("%d graphs in %.3f s, %.3f graphs/s\n", range, secs, range / secs);
+  printf("%d total solutions\n", tp.nsols.load());
+  delete[] threads;
+  delete[] groups;
+  pthread_mutex_destroy(&tp.output);
+  pthread_barrier_destroy(&tp.start);
+  return 0;
+}
+
 int main(int argc, char **argv) {
   u32 nthreads = 1;
   u32 ntrims = EDGEBITS > 30 ? 96 : 68;
@@ -23,19 +166,97 @@ int main(int argc, char **argv) {
   char header[HEADERLEN];
   u32 len;
   bool allrounds = false;
+  bool pipelined = false;
+  bool numa = false;
+  bool dynamic = false;
+  bool keepalive = false;
+  u32 compressround = COMPRESSROUND;
+  u32 expandround = EXPANDROUND;
+  u32 slices = SLICED ? edgetrimmer::minslices() : 0;
+  u32 ngroups = 1;
+  double minreduction = -1.0;
+  u64 targetedges = 0;
+  FILE *jsonf = 0;
   int c;
 
   memset(header, 0, sizeof(header));
-  while ((c = getopt (argc, argv, "ah:m:n:r:st:x:")) != -1) {
+  while ((c = getopt (argc, argv, "abc:d:DE:e:g:h:i:j:K:l:m:Nn:pr:st:T:x:")) != -1) {
     switch (c) {
       case 'a':
         allrounds = true;
         break;
+      case 'b': // keep a bitmap of edges surviving genVnodes, so nonce recovery hashes only those, some 63%
+#ifdef SAVEEDGES
+        printf("-b unneeded with SAVEEDGES, which keeps the edges themselves\n");
+        exit(1);
+#endif
+        keepalive = true;
+        break;
+      case 'c': // YZ compression round, as tuned by dispatch.cpp -A
+        compressround = atoi(optarg);
+        if (BIGGERSIZE == BIGSIZE)
+          expandround = compressround;
+        break;
+      case 'E': // round at which entries grow a byte
+        if (BIGGERSIZE == BIGSIZE) {
+          printf("This solver was built without EXPANDROUND\n");
+          exit(1);
+        }
+        expandround = atoi(optarg);
+        break;
+      case 'K': // slices of bucket rows in the first rounds, trading time for a smaller matrix
+        slices = atoi(optarg);
+        if (!SLICED) {
+          printf("This solver was built to hold all edges; slicing needs MATRIXFRAC, as in the lm layout\n");
+          exit(1);
+        }
+        if (slices < edgetrimmer::minslices()) {
+          printf("A matrix for %s of edges needs at least %d slices\n", LAYOUTNAME(MATRIXFRAC), edgetrimmer::minslices());
+          exit(1);
+        }
+        break;
+      case 'd': // stop trimming once a pair of rounds removes less than this fraction of edges
+        minreduction = atof(optarg);
+        break;
+      case 'T': // or once no more than this many edges are left
+        targetedges = atoll(optarg);
+        break;
+      case 'D': // hand out bucket columns to threads on demand, to even out their loads
+        dynamic = true;
+        break;
+      case 'e': // as picked by dispatch.cpp, or checked against a fixed size build
+        if (atoi(optarg) != EDGEBITS) {
+          printf("This solver was built for EDGEBITS=%d\n", EDGEBITS);
+          exit(1);
+        }
+        break;
+      case 'g': // solve this many graphs at once, each on -t threads of its own
+        ngroups = atoi(optarg);
+        break;
+      case 'i': // likewise for the instruction set
+        if (strcmp(optarg, SIMDISA)) {
+          printf("This solver was built for %s\n", SIMDISA);
+          exit(1);
+        }
+        break;
+      case 'l': // and the bucket layout variant
+        if (strcmp(optarg, LAYOUTNAME(LAYOUT))) {
+          printf("This solver was built for the %s layout\n", LAYOUTNAME(LAYOUT));
+          exit(1);
+        }
+        break;
       case 'h':
         len = strlen(optarg);
         assert(len <= sizeof(header));
         memcpy(header, optarg, len);
         break;
+      case 'j': // write per round statistics of each nonce as a line of JSON
+        jsonf = fopen(optarg, "w");
+        if (!jsonf) {
+          perror(optarg);
+          exit(1);
+        }
+        break;
       case 'x':
         len = strlen(optarg)/2;
         assert(len == sizeof(header));
@@ -45,6 +266,16 @@ int main(int argc, char **argv) {
       case 'n':
         nonce = atoi(optarg);
         break;
+      case 'N': // pin threads to NUMA nodes, each owning its part of the buckets
+        numa = true;
+        break;
+      case 'p': // overlap cycle finding with trimming the next nonce
+#ifdef SAVEEDGES
+        printf("-p unsupported with SAVEEDGES, which needs the buckets for nonce recovery\n");
+        exit(1);
+#endif
+        pipelined = true;
+        break;
       case 'r':
         range = atoi(optarg);
         break;
@@ -59,52 +290,102 @@ int main(int argc, char **argv) {
         break;
     }
   }
+  if (keepalive && pipelined) {
+    printf("-b conflicts with -p, which trims the next graph over the bitmap before nonce recovery\n");
+    exit(1);
+  }
+  if (ngroups > 1 && (pipelined || numa)) {
+    printf("-g conflicts with -p and -N, whose threads serve a single solver\n");
+    exit(1);
+  }
+  if (dynamic && numa) {
+    printf("-D conflicts with -N, which keeps threads on the bucket rows they own\n");
+    exit(1);
+  }
+  if (COMPRESSROUND && (compressround & 1 || compressround < 2 || compressround >= ntrims-2)) {
+    printf("Compression round %d must be even, and below %d trimming rounds less two\n", compressround, ntrims);
+    exit(1);
+  }
+  if (BIGGERSIZE > BIGSIZE && expandround >= compressround) {
+    printf("Expansion round %d must precede compression round %d\n", expandround, compressround);
+    exit(1);
+  }
+  if (slices && expandround < 4) {
+    printf("Sliced rounds and the two after need compression and expansion no earlier than round 4\n");
+    exit(1);
+  }
   printf("Looking for %d-cycle on cuckoo%d(\"%s\",%d", PROOFSIZE, NODEBITS, header, nonce);
   if (range > 1)
     printf("-%d", nonce+range-1);
   printf(") with 50%% edges\n");
 
-  solver_ctx ctx(nthreads, ntrims, allrounds, showcycle);
+  const solveropts opts = { nthreads, ntrims, allrounds, showcycle, dynamic, keepalive,
+                            compressround, expandround, slices, minreduction, targetedges };
+  if (ngroups > 1) {
+    if (slices)
+      printf("Matrices hold %s of edges, with the first rounds in %d slices.\n", LAYOUTNAME(MATRIXFRAC), (NX + edgetrimmer::slicerows(slices)-1) / edgetrimmer::slicerows(slices));
+    int rc = solvegroups(opts, ngroups, header, nonce, range, jsonf);
+    if (jsonf)
+      fclose(jsonf);
+    return rc;
+  }
+  solver_ctx ctx(nthreads, ntrims, allrounds, showcycle, pipelined, numa);
+  setup(ctx, opts);
 
   u64 sbytes = ctx.sharedbytes();
   u32 tbytes = ctx.threadbytes();
   int sunit,tunit;
   for (sunit=0; sbytes >= 10240; sbytes>>=10,sunit++) ;
   for (tunit=0; tbytes >= 10240; tbytes>>=10,tunit++) ;
-  printf("Using %d%cB bucket memory at %lx,\n", sbytes, " KMGT"[sunit], (u64)ctx.trimmer.buckets);
-  printf("%dx%d%cB thread memory at %lx,\n", nthreads, tbytes, " KMGT"[tunit], (u64)ctx.trimmer.tbuckets);
-  printf("%d-way siphash, and %d buckets.\n", NSIPHASH, NX);
+  printf("Using %d%cB bucket memory at %lx on %s pages,\n", sbytes, " KMGT"[sunit], (u64)ctx.trimmer.buckets, ctx.trimmer.bucketpages->name());
+  printf("%dx%d%cB thread memory at %lx on %s pages,\n", nthreads, tbytes, " KMGT"[tunit], (u64)ctx.trimmer.tbuckets, ctx.trimmer.tbucketpages->name());
+  printf("%d-way %s siphash, and %d buckets in %s layout.\n", NSIPHASH, SIMDISA, NX, LAYOUTNAME(LAYOUT));
+  if (compressround != COMPRESSROUND)
+    printf("Compressing at round %d.\n", compressround);
+  if (slices)
+    printf("Matrix holds %s of edges, with the first rounds in %d slices.\n", LAYOUTNAME(MATRIXFRAC), (NX + edgetrimmer::slicerows(slices)-1) / edgetrimmer::slicerows(slices));
+  if (keepalive && !slices)
+    printf("Keeping a bitmap of %d%cB of the edges surviving round 1, for nonce recovery to hash.\n", NEDGES >= 8 << 20 ? (u32)(NEDGES >> 23) : (u32)(NEDGES >> 13), NEDGES >= 8 << 20 ? 'M' : 'K');
+  if (numa)
+    printf("Threads pinned to %d NUMA nodes, owning their bucket rows.\n", ctx.trimmer.topology.nnodes);
+  if (dynamic)
+    printf("Threads claim bucket columns dynamically.\n");
+  if (ctx.trimmer.adaptive)
+    printf("Trimming at most %d rounds, until two remove under %.1f%% of edges or %lu remain.\n", ntrims, 100.0 * ctx.trimmer.minreduction, ctx.trimmer.targetedges);
+  if (pipelined) {
+    u64 rbytes = ctx.residualbytes();
+    int runit;
+    for (runit=0; rbytes >= 10240; rbytes>>=10,runit++) ;
+    printf("Pipelining nonces with %d%cB residual memory.\n", rbytes, " KMGT"[runit]);
+    ctx.setheadernonce(header, sizeof(header), nonce);
+    ctx.starttrim();
+  }
 
   u32 sumnsols = 0;
   for (u32 r = 0; r < range; r++) {
     gettimeofday(&time0, 0);
-    ctx.setheadernonce(header, sizeof(header), nonce + r);
-    printf("nonce %d k0 k1 k2 k3 %llx %llx %llx %llx\n", nonce+r, ctx.trimmer.sip_keys.k0, ctx.trimmer.sip_keys.k1, ctx.trimmer.sip_keys.k2, ctx.trimmer.sip_keys.k3);
-    u32 nsols = ctx.solve();
+    u32 nsols;
+    if (pipelined) {
+      ctx.endtrim();
+      if (r+1 < range) {
+        ctx.setheadernonce(header, sizeof(header), nonce + r+1);
+        ctx.starttrim();
+      }
+    } else ctx.setheadernonce(header, sizeof(header), nonce + r);
+    siphash_keys *keys = ctx.sipkeys();
+    printf("nonce %d k0 k1 k2 k3 %llx %llx %llx %llx\n", nonce+r, keys->k0, keys->k1, keys->k2, keys->k3);
+    nsols = pipelined ? ctx.solveresidual() : ctx.solve();
     gettimeofday(&time1, 0);
     timems = (time1.tv_sec-time0.tv_sec)*1000 + (time1.tv_usec-time0.tv_usec)/1000;
     printf("Time: %d ms\n", timems);
+    if (jsonf)
+      ctx.stats().json(jsonf, EDGEBITS, nonce + r);
 
-    for (unsigned s = 0; s < nsols; s++) {
-      printf("Solution");
-      word_t *prf = &ctx.sols[s * PROOFSIZE];
-      for (u32 i = 0; i < PROOFSIZE; i++)
-        printf(" %jx", (uintmax_t)prf[i]);
-      printf("\n");
-      int pow_rc = verify(prf, &ctx.trimmer.sip_keys);
-      if (pow_rc == POW_OK) {
-        printf("Verified with cyclehash ");
-        unsigned char cyclehash[32];
-        blake2b((void *)cyclehash, sizeof(cyclehash), (const void *)prf, sizeof(proof), 0, 0);
-        for (int i=0; i<32; i++)
-          printf("%02x", cyclehash[i]);
-        printf("\n");
-      } else {
-        printf("FAILED due to %s\n", errstr[pow_rc]);
-      }
-    }
+    report(ctx, nsols);
     sumnsols += nsols;
   }
   printf("%d total solutions\n", sumnsols);
+  if (jsonf)
+    fclose(jsonf);
   return 0;
 }
@@ -16,7 +16,12 @@
 #include <assert.h>
 #include <vector>
 #include <bitset>
+#include <atomic>
 #include "graph.hpp"
+#include "hugepages.hpp"
+#include "numa.hpp"
+#include "metrics.hpp"
+#include "../threads/threadpool.hpp"
 #ifdef __APPLE__
 #include "../apple/osx_barrier.h"
 #endif
@@ -50,10 +55,47 @@
 #define MAXSOLS 4
 #endif
 
+// built into libcuckatoo, which must neither print nor exit, progress is
+// left to the caller's reading of the metrics, and a failed sanity check,
+// that would end a miner, merely marks the trim as failed
+#ifdef LIBCUCKATOO
+#define QUIET 1
+#define OOPS(...) failed.store(true, std::memory_order_relaxed)
+#else
+#define QUIET 0
+#define OOPS(...) { printf(__VA_ARGS__); exit(1); }
+#endif
+
+// instruction set the siphash and sorting kernels are compiled for,
+// as named in dispatch.cpp
+#if defined __AVX512F__
+#define SIMDISA "avx512"
+#elif defined __AVX2__
+#define SIMDISA "avx2"
+#elif defined __SSE4_1__
+#define SIMDISA "sse4"
+#elif defined __SSE2__
+#define SIMDISA "sse2"
+#else
+#define SIMDISA "generic"
+#endif
+
 #ifndef XBITS
 // 7 seems to give best performance
 #define XBITS 7
 #endif
+// genVnodes counts Z values in 16 bits
+#if EDGEBITS - 2*XBITS > 16
+#error "EDGEBITS - 2*XBITS exceeds 16; raise XBITS"
+#endif
+
+// name of the bucket layout variant an instance is built with, as chosen
+// among by dispatch.cpp and its autotuner
+#ifndef LAYOUT
+#define LAYOUT std
+#endif
+#define LAYOUTSTR(l) #l
+#define LAYOUTNAME(l) LAYOUTSTR(l)
 
 #define YBITS XBITS
 
@@ -73,6 +115,13 @@
 #endif
 // size in bytes of a small bucket entry
 #define SMALLSIZE BIGSIZE
+// entries may grow a byte at the expansion round, to lower overflow risk
+#ifdef EXPANDROUND
+#define BIGGERSIZE BIGSIZE+1
+#else
+#define BIGGERSIZE BIGSIZE
+#define EXPANDROUND COMPRESSROUND
+#endif
 
 // initial entries could be smaller at percent or two slowdown
 #ifndef BIGSIZE0
@@ -82,10 +131,22 @@
 #define BIGSIZE0 BIGSIZE
 #endif
 #endif
-// but they may need syncing entries
-#if BIGSIZE0 == 4 && EDGEBITS > 27
+// fraction of all edges the bucket matrix is sized for. below 1, it can't
+// hold the first rounds, which must then be trimmed in slices (see slicetrim)
+#ifndef MATRIXFRAC
+#define MATRIXFRAC 1
+#define SLICED 0
+#else
+#define SLICED 1
+#endif
+// but they may need syncing entries, as do the sparser buckets of the
+// rounds that follow slicing
+#if BIGSIZE0 == 4 && (EDGEBITS > 27 || SLICED)
 #define NEEDSYNC
 #endif
+#if SLICED && defined SAVEEDGES
+#error "SAVEEDGES needs all edges in the matrix; drop MATRIXFRAC"
+#endif
 
 typedef uint8_t u8;
 typedef uint16_t u16;
@@ -133,6 +194,9 @@ const static u32 YZZBITS   = YZBITS + ZBITS;
 const static u32 YZZ1BITS  = YZ1BITS + ZBITS;
 
 const static u32 MAXEDGES = NX * NYZ2;
+// most edges adaptive trimming may leave for the final renaming pair, which
+// needs fewer than NYZ2 in every bucket column; 1/8 margin over the average
+const static u32 ADAPTEDGES = MAXEDGES - MAXEDGES/8;
 
 const static u32 BIGSLOTBITS   = BIGSIZE * 8;
 const static u32 SMALLSLOTBITS = SMALLSIZE * 8;
@@ -150,9 +214,15 @@ const static u32 NNONYZ        = 1 << NONYZBITS;
 
 // 1/32 reduces odds of overflowing z bucket on 2^30 nodes to 2^14*e^-32
 // (less than 1 in a billion) in theory. not so in practice (fails first at mean30 -n 1549)
+// big buckets that do overflow spill into a small shared arena (see
+// spillarena), so BIGEPS can be lowered to save memory at a little slowdown
 #ifndef BIGEPS
 #define BIGEPS 3/64
 #endif
+// the per thread small buckets can't spill, but are few enough to be generous
+#ifndef SMALLEPS
+#define SMALLEPS 3/64
+#endif
 
 // 176/256 is safely over 1-e(-1) ~ 0.63 trimming fraction
 #ifndef TRIMFRAC256
@@ -161,17 +231,36 @@ const static u32 NNONYZ        = 1 << NONYZBITS;
 
 const static u32 NTRIMMEDZ  = NZ * TRIMFRAC256 / 256;
 
-const static u32 ZBUCKETSLOTS = NZ + NZ * BIGEPS;
+const static u32 ZBUCKETSLOTS = NZ * MATRIXFRAC + NZ * BIGEPS;
 #ifdef SAVEEDGES
 const static u32 ZBUCKETSIZE = NTRIMMEDZ * (BIGSIZE + sizeof(u32));  // assumes EDGEBITS <= 32
 #else
 const static u32 ZBUCKETSIZE = ZBUCKETSLOTS * BIGSIZE0; 
 #endif
-const static u32 TBUCKETSIZE = ZBUCKETSLOTS * BIGSIZE; 
+const static u32 TBUCKETSLOTS = NZ + NZ * SMALLEPS;
+const static u32 TBUCKETSIZE = TBUCKETSLOTS * BIGSIZE; 
+
+// chunks in the spill arena for each round, and their size in bytes
+const static u32 NSPILLS = NX * NY / 64 > 16 ? NX * NY / 64 : 16;
+const static u32 SPILLSIZE = ZBUCKETSIZE / 8 & ~63;
+
+#define likely(x)   __builtin_expect((x)!=0, 1)
+#define unlikely(x) __builtin_expect((x), 0)
+
+// the rename tables at the end of each zbucket (see trimrename and trimrename1)
+// mapping compressed YZ values back to their originals
+struct renametables {
+  u32 renameu1[NZ2/2];
+  u32 renamev1[NZ2/2];
+  u32 renameu[COMPRESSROUND ? NZ1/2 : 0];
+  u32 renamev[COMPRESSROUND ? NZ1/2 : 0];
+};
 
 template<u32 BUCKETSIZE>
 struct zbucket {
-  u32 size;
+  u32 size;       // bytes of entries in the bucket
+  u32 spilled;    // and in its spill chunk,
+  offset_t spill; // at this offset from the bucket matrix
   const static u32 RENAMESIZE = NZ2 + (COMPRESSROUND ? NZ1 : 0);
   union alignas(16) {
     u8 bytes[BUCKETSIZE];
@@ -190,11 +279,31 @@ struct zbucket {
 #endif
     };
   };
-  u32 setsize(u8 const *end) {
+  // span is more than BUCKETSIZE for the buckets of sliced rounds, which
+  // run on into the next ones (see edgetrimmer::slicebucket)
+  u32 setsize(u8 const *end, const u32 span = BUCKETSIZE) {
     size = end - bytes;
-    assert(size <= BUCKETSIZE);
+    spilled = 0;
+    assert(size <= span);
     return size;
   }
+  u32 setsize(u8 const *end, const offset_t chunk, const u32 chunkbytes, const u32 span = BUCKETSIZE) {
+    setsize(end, span);
+    spill = chunk;
+    spilled = chunkbytes;
+    return size + spilled;
+  }
+  // whether entries remain at read before end, moving on from the end of
+  // the bucket to its spill chunk, if any
+  bool more(u8 const *base, const u8 *&read, const u8 *&end) const {
+    if (likely(read < end))
+      return true;
+    if (likely(!spilled) || end != bytes + size)
+      return false;
+    read = base + spill;
+    end = read + spilled;
+    return true;
+  }
 };
 
 template<u32 BUCKETSIZE>
@@ -202,64 +311,233 @@ using yzbucket = zbucket<BUCKETSIZE>[NY];
 template <u32 BUCKETSIZE>
 using matrix = yzbucket<BUCKETSIZE>[NX];
 
+// where big buckets overflowing in the rounds before compression continue,
+// in the same memory right after the bucket matrix: a chunk per bucket, taken
+// from the half of the arena for odd or even rounds, as the spills of one
+// round are read in the next. from compression on entries are 4 bytes, so
+// even a bucket that spilled before only fills nine tenths of one after
+struct spillarena {
+  offset_t start;           // of the first chunk, from the bucket matrix
+  std::atomic<u32> *claims; // chunks handed out in each round
+
+  const static u64 BYTES = 2 * NSPILLS * (u64)SPILLSIZE;
+
+  // offset of a free chunk, or 0 if round ran out of them
+  offset_t claim(const u32 round) {
+    const u32 c = claims[round].fetch_add(1, std::memory_order_relaxed);
+    return c < NSPILLS ? start + ((round & 1) * NSPILLS + c) * (offset_t)SPILLSIZE : 0;
+  }
+};
+
 template<u32 BUCKETSIZE>
 struct indexer {
   offset_t index[NX];
-
+  offset_t end[NX];    // of bucket or its spill chunk
+  offset_t spill[NX];  // start of spill chunk, or 0 if bucket fits
+  offset_t filled[NX]; // end of bucket once it spilled
+  spillarena *spills;  // 0 for buckets without one to overflow into
+  std::atomic<bool> *failed; // the trim's, for overflowing quietly
+  u32 round;
+  u32 nspills;
+  u32 span;            // bytes of each bucket opened
+
+  indexer(std::atomic<bool> *fail, spillarena *arena = 0, const u32 r = 0) {
+    failed = fail;
+    spills = arena;
+    round = r;
+    nspills = 0;
+    span = BUCKETSIZE;
+  }
+  void open(const u32 x, const offset_t start) {
+    index[x] = start;
+    end[x] = start + span;
+    spill[x] = 0;
+  }
   void matrixv(const u32 y) {
     const yzbucket<BUCKETSIZE> *foo = 0;
     for (u32 x = 0; x < NX; x++)
-      index[x] = foo[x][y].bytes - (u8 *)foo;
+      open(x, foo[x][y].bytes - (u8 *)foo);
+  }
+  void matrixu(const u32 x) {
+    const yzbucket<BUCKETSIZE> *foo = 0;
+    for (u32 y = 0; y < NY; y++)
+      open(y, foo[x][y].bytes - (u8 *)foo);
+  }
+  // the slow path of put, continuing bucket x in a spill chunk. a bucket
+  // gets one at most, which bounds what reading it back has to follow
+  void overflow(const u32 x) {
+    const offset_t chunk = spills && !spill[x] ? spills->claim(round) : 0;
+    if (!chunk) {
+#ifdef LIBCUCKATOO
+      // overwrite the bucket's last chunk rather than run past its end
+      failed->store(true, std::memory_order_relaxed);
+      index[x] = spill[x] ? spill[x] : end[x] - span;
+      return;
+#else
+      if (!spills)
+        printf("bucket overflow in a round without spill chunks; raise %s\n", BUCKETSIZE == TBUCKETSIZE ? "SMALLEPS" : "BIGEPS");
+      else if (spill[x])
+        printf("bucket overflow in round %d past its one spill chunk; raise BIGEPS\n", round);
+      else printf("bucket overflow in round %d finds all %d spill chunks taken; raise BIGEPS\n", round, NSPILLS);
+      exit(1);
+#endif
+    }
+    nspills++;
+    filled[x] = index[x];
+    index[x] = spill[x] = chunk;
+    end[x] = chunk + SPILLSIZE;
+  }
+  u32 store(zbucket<BUCKETSIZE> &zb, u8 const *base, const u32 x) {
+    if (likely(!spill[x]))
+      return zb.setsize(base+index[x], span);
+    return zb.setsize(base+filled[x], spill[x], index[x] - spill[x], span);
   }
   offset_t storev(yzbucket<BUCKETSIZE> *buckets, const u32 y) {
     u8 const *base = (u8 *)buckets;
     offset_t sumsize = 0;
     for (u32 x = 0; x < NX; x++)
-      sumsize += buckets[x][y].setsize(base+index[x]);
+      sumsize += store(buckets[x][y], base, x);
     return sumsize;
   }
-  void matrixu(const u32 x) {
-    const yzbucket<BUCKETSIZE> *foo = 0;
-    for (u32 y = 0; y < NY; y++)
-      index[y] = foo[x][y].bytes - (u8 *)foo;
-  }
   offset_t storeu(yzbucket<BUCKETSIZE> *buckets, const u32 x) {
     u8 const *base = (u8 *)buckets;
     offset_t sumsize = 0;
     for (u32 y = 0; y < NY; y++)
-      sumsize += buckets[x][y].setsize(base+index[y]);
+      sumsize += store(buckets[x][y], base, y);
     return sumsize;
   }
+  // store v at the end of bucket x, then advance it by size
+  template <typename T>
+  void put(u8 const *base, const u32 x, const T v, const u32 size) {
+    if (unlikely(index[x] + sizeof(T) > end[x]))
+      overflow(x);
+    *(T *)(base+index[x]) = v;
+    index[x] += size;
+  }
 };
 
-#define likely(x)   __builtin_expect((x)!=0, 1)
-#define unlikely(x) __builtin_expect((x), 0)
-
-class edgetrimmer; // avoid circular references
-
-typedef struct {
-  u32 id;
-  pthread_t thread;
-  edgetrimmer *et;
-} thread_ctx;
+#ifdef WRITECOMBINE
+// an indexer that stages writes in a 64 byte line per bucket, and writes out
+// whole lines with non-temporal stores. plain stores of a few bytes into
+// buckets far bigger than cache make every line get read in for ownership
+// first, only to be overwritten; streaming stores skip that read, which
+// can halve the memory traffic of a write only phase like genUnodes.
+// partial lines at either end of a bucket, shared with its neighbours,
+// are written with plain stores
+template<u32 BUCKETSIZE>
+struct wcindexer : indexer<BUCKETSIZE> {
+  using indexer<BUCKETSIZE>::index;
+  using indexer<BUCKETSIZE>::end;
+  u32 lo[NX];                  // first byte of current line that is ours
+  alignas(64) u8 lines[NX][72]; // with room for a u64 store at byte 63
+
+  wcindexer(std::atomic<bool> *fail, spillarena *arena = 0, const u32 r = 0) : indexer<BUCKETSIZE>(fail, arena, r) { }
+  void stage(const u32 x) {
+    lo[x] = index[x] & 63;
+  }
+  void matrixv(const u32 y) {
+    indexer<BUCKETSIZE>::matrixv(y);
+    for (u32 x = 0; x < NX; x++)
+      stage(x);
+  }
+  void matrixu(const u32 x) {
+    indexer<BUCKETSIZE>::matrixu(x);
+    for (u32 y = 0; y < NY; y++)
+      stage(y);
+  }
+  // write out staged bytes lo[x] up to end of line
+  void flush(u8 const *base, const u32 x, const u32 end) {
+    u8 *line = (u8 *)base + (index[x] & ~(offset_t)63);
+    if (lo[x] == 0 && end == 64) {
+      for (u32 i = 0; i < 64; i += 16)
+        _mm_stream_si128((__m128i *)(line + i), _mm_loadu_si128((__m128i *)(lines[x] + i)));
+    } else memcpy(line + lo[x], lines[x] + lo[x], end - lo[x]);
+  }
+  template <typename T>
+  void put(u8 const *base, const u32 x, const T v, const u32 size) {
+    if (unlikely(index[x] + sizeof(T) > end[x])) {
+      flush(base, x, index[x] & 63);
+      this->overflow(x);
+      stage(x);
+    }
+    const u32 pos = index[x] & 63;
+    *(T *)(lines[x] + pos) = v;
+    if (pos + size >= 64) {
+      flush(base, x, 64);
+      if (pos + sizeof(T) > 64) // store straddles lines
+        memcpy(lines[x], lines[x] + 64, pos + sizeof(T) - 64);
+      lo[x] = 0;
+    }
+    index[x] += size;
+  }
+  offset_t storev(yzbucket<BUCKETSIZE> *buckets, const u32 y) {
+    u8 *base = (u8 *)buckets;
+    offset_t sumsize = 0;
+    for (u32 x = 0; x < NX; x++) {
+      flush(base, x, index[x] & 63);
+      sumsize += this->store(buckets[x][y], base, x);
+    }
+    _mm_sfence();
+    return sumsize;
+  }
+  offset_t storeu(yzbucket<BUCKETSIZE> *buckets, const u32 x) {
+    u8 *base = (u8 *)buckets;
+    offset_t sumsize = 0;
+    for (u32 y = 0; y < NY; y++) {
+      flush(base, y, index[y] & 63);
+      sumsize += this->store(buckets[x][y], base, y);
+    }
+    _mm_sfence();
+    return sumsize;
+  }
+};
+template<u32 BUCKETSIZE>
+using bigindexer = wcindexer<BUCKETSIZE>;
+#else
+template<u32 BUCKETSIZE>
+using bigindexer = indexer<BUCKETSIZE>;
+#endif
 
 typedef u8 zbucket8[NYZ1];
-typedef u16 zbucket16[NTRIMMEDZ];
-typedef u32 zbucket32[NTRIMMEDZ];
+// the survivors of a whole thread bucket, so that genVnodes stays within
+// them even when more than NTRIMMEDZ survive, which it then reports
+typedef u16 zbucket16[TBUCKETSLOTS];
+typedef u32 zbucket32[TBUCKETSLOTS];
 
 // maintains set of trimmable edges
 class edgetrimmer {
 public:
-  siphash_keys sip_keys;
+  alignas(64) siphash_keys sip_keys; // aligned for vector loads of keys
+  hugepages *bucketpages;
+  hugepages *tbucketpages;
   yzbucket<ZBUCKETSIZE> *buckets;
   yzbucket<TBUCKETSIZE> *tbuckets;
   zbucket32 *tedges;
+  u32 *tkills;       // TBUCKETSLOTS per thread, of edges to clear in alive, if kept
   zbucket16 *tzs;
   zbucket8 *tdegs;
   offset_t *tcounts;
   u32 ntrims;
   u32 nthreads;
   bool showall;
+  u32 compressround;   // of the YZ compression pair, COMPRESSROUND unless tuned
+  u32 expandround;     // where entries grow to BIGGERSIZE, before compressround
+  bool adaptive;       // stop trimming early once it stops paying off
+  double minreduction; // fraction of edges a pair of rounds must remove to go on
+  u64 targetedges;     // or count at or below which to stop right away
+  bool numa;
+  bool dynamic;        // hand out columns on demand rather than in fixed blocks
+  std::atomic<u32> *claims; // next column of each round, for dynamic
+  spillarena spills;
+  std::atomic<bool> failed; // a sanity check or bucket of the last trim, in QUIET builds
+  std::atomic<bool> cancelled; // by another thread, abandoning the trim
+  std::atomic<u32> haltbarrier; // number of the first barrier after which to stop
+  u32 *nbarriers;               // passed by each thread in this trim
+  u32 slices;               // of bucket rows in the first rounds, or 0 for not slicing
+  std::atomic<u64> *alive;  // bit per edge not yet trimmed by sliced rounds
+  numatopology topology;
+  threadpool *pool;
+  trimmetrics stats; // of the last (or current) trim
   pthread_barrier_t barry;
 
 #if NSIPHASH > 4
@@ -277,38 +555,110 @@ public:
 
 #endif
 
-  void touch(u8 *p, const offset_t n) {
-    for (offset_t i=0; i<n; i+=4096)
+  void touch(const hugepages *mem) {
+    u8 *p = (u8 *)mem->ptr;
+    for (u64 i=0; i<mem->bytes; i+=mem->pagesize)
       *(u32 *)(p+i) = 0;
   }
-  edgetrimmer(const u32 n_threads, const u32 n_trims, const bool show_all) {
+  edgetrimmer(threadpool *workers, const u32 n_trims, const bool show_all, const bool numa_aware)
+    : stats(workers->nthreads, n_trims) {
     assert(sizeof(matrix<ZBUCKETSIZE>) == NX * sizeof(yzbucket<ZBUCKETSIZE>));
     assert(sizeof(matrix<TBUCKETSIZE>) == NX * sizeof(yzbucket<TBUCKETSIZE>));
-    nthreads = n_threads;
+    assert(sizeof(renametables) == zbucket<ZBUCKETSIZE>::RENAMESIZE * sizeof(u32));
+    pool     = workers;
+    nthreads = pool->nthreads;
     ntrims   = n_trims;
     showall = show_all;
-    buckets  = new yzbucket<ZBUCKETSIZE>[NX];
-    touch((u8 *)buckets, sizeof(matrix<ZBUCKETSIZE>));
-    tbuckets = new yzbucket<TBUCKETSIZE>[nthreads];
-    touch((u8 *)tbuckets, sizeof(yzbucket<TBUCKETSIZE>[nthreads]));
+    compressround = COMPRESSROUND;
+    expandround = EXPANDROUND;
+    adaptive = false;
+    minreduction = 0.0;
+    targetedges = 0;
+    numa = numa_aware;
+    dynamic = false;
+    claims = new std::atomic<u32>[ntrims];
+    slices = 0;
+    alive = 0;
+    spills.claims = new std::atomic<u32>[ntrims];
+    failed = false;
+    cancelled = false;
+    spills.start = (sizeof(matrix<ZBUCKETSIZE>) + 63) & ~63;
+    bucketpages  = new hugepages(spills.start + spillarena::BYTES);
+    buckets  = (yzbucket<ZBUCKETSIZE> *)bucketpages->ptr;
+    tbucketpages = new hugepages(sizeof(yzbucket<TBUCKETSIZE>[nthreads]));
+    tbuckets = (yzbucket<TBUCKETSIZE> *)tbucketpages->ptr;
+    if (numa)
+      pool->run(placeworker, this);
+    else {
+      touch(bucketpages);
+      touch(tbucketpages);
+    }
 #ifdef SAVEEDGES
     tedges  = 0;
 #else
     tedges  = new zbucket32[nthreads];
 #endif
+    tkills  = 0;
     tdegs   = new zbucket8[nthreads];
     tzs     = new zbucket16[nthreads];
     tcounts = new offset_t[nthreads];
+    nbarriers = new u32[nthreads];
     int err = pthread_barrier_init(&barry, NULL, nthreads);
     assert(err == 0);
   }
   ~edgetrimmer() {
-    delete[] buckets;
-    delete[] tbuckets;
+    delete bucketpages;
+    delete tbucketpages;
     delete[] tedges;
+    delete[] tkills;
     delete[] tdegs;
     delete[] tzs;
     delete[] tcounts;
+    delete[] nbarriers;
+    delete[] claims;
+    delete[] spills.claims;
+    delete[] alive;
+  }
+  static void placeworker(void *et, const u32 id) {
+    ((edgetrimmer *)et)->place(id);
+  }
+  // pin worker id to its node for good, and have it first touch the bucket
+  // rows it writes in genVnodes and the odd rounds, as well as its own tbucket
+  void place(const u32 id) {
+    const u32 node = topology.node(id, nthreads);
+    topology.pin(node);
+    const u32 startux = NX *  id    / nthreads;
+    const u32   endux = NX * (id+1) / nthreads;
+    u8 *row = (u8 *)buckets[startux], *endrow = (u8 *)buckets[endux];
+    topology.bind(row, endrow - row, node);
+    for (; row < endrow; row += 4096)
+      *(u32 *)row = 0;
+    u8 *tb = (u8 *)tbuckets[id], *endtb = (u8 *)tbuckets[id+1];
+    topology.bind(tb, endtb - tb, node);
+    for (; tb < endtb; tb += 4096)
+      *(u32 *)tb = 0;
+  }
+  // first column (or row) of round for thread id to work on, and the ones
+  // after col. statically, each thread gets the same contiguous block every
+  // round, as NUMA placement expects. dynamically, threads claim one at a time
+  // until none are left, so a slow thread holds up the barrier by one at most
+  u32 firstcolumn(const u32 id, const u32 round) {
+    if (dynamic)
+      return claims[round].fetch_add(1, std::memory_order_relaxed);
+    const u32 col = NX * id / nthreads;
+    return col < NX * (id+1) / nthreads ? col : NX;
+  }
+  u32 nextcolumn(const u32 id, const u32 round, const u32 col) {
+    if (cancelling())
+      return NX;
+    if (dynamic)
+      return claims[round].fetch_add(1, std::memory_order_relaxed);
+    return col+1 < NX * (id+1) / nthreads ? col+1 : NX;
+  }
+  // checked between columns (or rows), leaving the rest of a cancelled round
+  // undone, for the barrier after it to stop all threads
+  bool cancelling() const {
+    return cancelled.load(std::memory_order_relaxed);
   }
   offset_t count() const {
     offset_t cnt = 0;
@@ -318,14 +668,13 @@ public:
   }
 
   void genUnodes(const u32 id, const u32 uorv) {
-    u64 rdtsc0, rdtsc1;
 #ifdef NEEDSYNC
     u32 last[NX];;
 #endif
   
-    rdtsc0 = __rdtsc();
+    const phasetimer timer;
     u8 const *base = (u8 *)buckets;
-    indexer<ZBUCKETSIZE> dst;
+    bigindexer<ZBUCKETSIZE> dst(&failed, &spills, uorv);
     const u32 starty = NY *  id    / nthreads;
     const u32   endy = NY * (id+1) / nthreads;
     u32 edge = starty << YZBITS, endedge = edge + NYZ;
@@ -354,9 +703,14 @@ public:
     __m256i vhi0 = _mm256_set_epi64x((e1+3)<<YZBITS, (e1+2)<<YZBITS, (e1+1)<<YZBITS, (e1+0)<<YZBITS);
     __m256i vhi1 = _mm256_set_epi64x((e1+7)<<YZBITS, (e1+6)<<YZBITS, (e1+5)<<YZBITS, (e1+4)<<YZBITS);
     static const __m256i vhiinc = {8<<YZBITS, 8<<YZBITS, 8<<YZBITS, 8<<YZBITS};
+#elif NSIPHASH >= 16
+    alignas(64) u64 indices[NSIPHASH];
+    alignas(64) u64 hashes[NSIPHASH];
+    for (u32 i = 0; i < NSIPHASH; i++)
+      indices[i] = 2 * (u64)(edge + i) + uorv;
 #endif
     offset_t sumsize = 0;
-    for (u32 my = starty; my < endy; my++, endedge += NYZ) {
+    for (u32 my = starty; my < endy && !cancelling(); my++, endedge += NYZ) {
       dst.matrixv(my);
 #ifdef NEEDSYNC
       for (u32 x=0; x < NX; x++)
@@ -372,14 +726,12 @@ public:
 #ifndef NEEDSYNC
 // bit        39..21     20..13    12..0
 // write        edge     YYYYYY    ZZZZZ
-        *(BIGTYPE0 *)(base+dst.index[ux]) = zz;
-        dst.index[ux] += BIGSIZE0;
+        dst.put(base, ux, zz, BIGSIZE0);
 #else
         if (zz) {
-          for (; unlikely(last[ux] + NNONYZ <= edge); last[ux] += NNONYZ, dst.index[ux] += BIGSIZE0)
-            *(u32 *)(base+dst.index[ux]) = 0;
-          *(u32 *)(base+dst.index[ux]) = zz;
-          dst.index[ux] += BIGSIZE0;
+          for (; unlikely(last[ux] + NNONYZ <= edge); last[ux] += NNONYZ)
+            dst.put(base, ux, (u32)0, BIGSIZE0);
+          dst.put(base, ux, (u32)zz, BIGSIZE0);
           last[ux] = edge;
         }
 #endif
@@ -416,18 +768,16 @@ public:
 #ifndef NEEDSYNC
 #define STORE0(i,v,x,w) \
   ux = extract32(v,x);\
-  *(u64 *)(base+dst.index[ux]) = _mm_extract_epi64(w,i%2);\
-  dst.index[ux] += BIGSIZE0;
+  dst.put(base, ux, (u64)_mm_extract_epi64(w,i%2), BIGSIZE0);
 #else
   u32 zz;
 #define STORE0(i,v,x,w) \
   zz = extract32(w,x);\
   if (i || likely(zz)) {\
     ux = extract32(v,x);\
-    for (; unlikely(last[ux] + NNONYZ <= edge+i); last[ux] += NNONYZ, dst.index[ux] += BIGSIZE0)\
-      *(u32 *)(base+dst.index[ux]) = 0;\
-    *(u32 *)(base+dst.index[ux]) = zz;\
-    dst.index[ux] += BIGSIZE0;\
+    for (; unlikely(last[ux] + NNONYZ <= edge+i); last[ux] += NNONYZ)\
+      dst.put(base, ux, (u32)0, BIGSIZE0);\
+    dst.put(base, ux, zz, BIGSIZE0);\
     last[ux] = edge+i;\
   }
 #endif
@@ -461,23 +811,40 @@ public:
 #ifndef NEEDSYNC
 #define STORE0(i,v,x,w) \
   ux = _mm256_extract_epi32(v,x);\
-  *(u64 *)(base+dst.index[ux]) = _mm256_extract_epi64(w,i%4);\
-  dst.index[ux] += BIGSIZE0;
+  dst.put(base, ux, (u64)_mm256_extract_epi64(w,i%4), BIGSIZE0);
 #else
   u32 zz;
 #define STORE0(i,v,x,w) \
   zz = _mm256_extract_epi32(w,x);\
   if (i || likely(zz)) {\
     ux = _mm256_extract_epi32(v,x);\
-    for (; unlikely(last[ux] + NNONYZ <= edge+i); last[ux] += NNONYZ, dst.index[ux] += BIGSIZE0)\
-      *(u32 *)(base+dst.index[ux]) = 0;\
-    *(u32 *)(base+dst.index[ux]) = zz;\
-    dst.index[ux] += BIGSIZE0;\
+    for (; unlikely(last[ux] + NNONYZ <= edge+i); last[ux] += NNONYZ)\
+      dst.put(base, ux, (u32)0, BIGSIZE0);\
+    dst.put(base, ux, zz, BIGSIZE0);\
     last[ux] = edge+i;\
   }
 #endif
         STORE0(0,v1,0,v0); STORE0(1,v1,2,v0); STORE0(2,v1,4,v0); STORE0(3,v1,6,v0);
         STORE0(4,v5,0,v4); STORE0(5,v5,2,v4); STORE0(6,v5,4,v4); STORE0(7,v5,6,v4);
+#elif NSIPHASH >= 16
+        siphash24xN(&sip_keys, indices, hashes);
+        for (u32 i = 0; i < NSIPHASH; i++)
+          indices[i] += 2 * NSIPHASH;
+        for (u32 i = 0; i < NSIPHASH; i++) {
+          const u32 node = hashes[i] & EDGEMASK;
+          const u32 ux = node >> YZBITS;
+          const BIGTYPE0 zz = (BIGTYPE0)(edge + i) << YZBITS | (node & YZMASK);
+#ifndef NEEDSYNC
+          dst.put(base, ux, zz, BIGSIZE0);
+#else
+          if (i || likely(zz)) {
+            for (; unlikely(last[ux] + NNONYZ <= edge+i); last[ux] += NNONYZ)
+              dst.put(base, ux, (u32)0, BIGSIZE0);
+            dst.put(base, ux, (u32)zz, BIGSIZE0);
+            last[ux] = edge+i;
+          }
+#endif
+        }
 #else
 #error not implemented
 #endif
@@ -485,20 +852,21 @@ public:
 #ifdef NEEDSYNC
       for (u32 ux=0; ux < NX; ux++) {
         for (; last[ux]<endedge-NNONYZ; last[ux]+=NNONYZ) {
-          *(u32 *)(base+dst.index[ux]) = 0;
-          dst.index[ux] += BIGSIZE0;
+          dst.put(base, ux, (u32)0, BIGSIZE0);
         }
       }
 #endif
       sumsize += dst.storev(buckets, my);
     }
-    rdtsc1 = __rdtsc();
-    if (!id) printf("genUnodes round %2d size %u rdtsc: %lu\n", uorv, sumsize/BIGSIZE0, rdtsc1-rdtsc0);
+    stats.record(uorv, id, "genUnodes", timer, sumsize/BIGSIZE0, 0, sumsize);
+    stats.at(uorv, id).spills = dst.nspills;
     tcounts[id] = sumsize/BIGSIZE0;
   }
 
-  void genVnodes(const u32 id, const u32 uorv) {
-    u64 rdtsc0, rdtsc1;
+  // round is 1, or later after sliced rounds. KILLS records the edges
+  // trimmed, to clear them in the alive bitmap, only kept with one
+  template <bool KILLS>
+  void genVnodes(const u32 id, const u32 uorv, const u32 round) {
 #if NSIPHASH == 4
     static const __m128i vxmask = {XMASK, XMASK};
     static const __m128i vyzmask = {YZMASK, YZMASK};
@@ -511,26 +879,28 @@ public:
     const __m256i vinit = _mm256_load_si256((__m256i *)&sip_keys);
     __m256i vpacket0, vpacket1, vhi0, vhi1;
     __m256i v0, v1, v2, v3, v4, v5, v6, v7;
+#elif NSIPHASH >= 16
+    alignas(64) u64 indices[NSIPHASH];
+    alignas(64) u64 hashes[NSIPHASH];
 #endif
     static const u32 NONDEGBITS = std::min(BIGSLOTBITS, 2 * YZBITS) - ZBITS;
     static const u32 NONDEGMASK = (1 << NONDEGBITS) - 1;
-    indexer<ZBUCKETSIZE> dst;
-    indexer<TBUCKETSIZE> small;
+    bigindexer<ZBUCKETSIZE> dst(&failed, &spills, round);
+    indexer<TBUCKETSIZE> small(&failed);
   
-    rdtsc0 = __rdtsc();
-    offset_t sumsize = 0;
+    const phasetimer timer;
+    offset_t sumsize = 0, readsize = 0;
     u8 const *base = (u8 *)buckets;
     u8 const *small0 = (u8 *)tbuckets[id];
-    const u32 startux = NX *  id    / nthreads;
-    const u32   endux = NX * (id+1) / nthreads;
-    for (u32 ux = startux; ux < endux; ux++) { // matrix x == ux
+    for (u32 ux = firstcolumn(id, round); ux < NX; ux = nextcolumn(id, round, ux)) { // matrix x == ux
       small.matrixu(0);
       for (u32 my = 0 ; my < NY; my++) {
         u32 edge = my << YZBITS;
-        u8    *readbig = buckets[ux][my].bytes;
-        u8 const *endreadbig = readbig + buckets[ux][my].size;
-// printf("id %d x %d y %d size %u read %d\n", id, ux, my, buckets[ux][my].size, readbig-base);
-        for (; readbig < endreadbig; readbig += BIGSIZE0) {
+        const zbucket<ZBUCKETSIZE> &zb = buckets[ux][my];
+        const u8 *readbig = zb.bytes, *endreadbig = readbig + zb.size;
+        readsize += zb.size + zb.spilled;
+// printf("id %d x %d y %d size %u read %d\n", id, ux, my, zb.size, readbig-base);
+        for (; zb.more(base, readbig, endreadbig); readbig += BIGSIZE0) {
 // bit     39/31..21     20..13    12..0
 // read         edge     UYYYYY    UZZZZ   within UX partition
           BIGTYPE0 e = *(BIGTYPE0 *)readbig;
@@ -544,12 +914,11 @@ public:
           const u32 uy = (e >> ZBITS) & YMASK;
 // bit         39..13     12..0
 // write         edge     UZZZZ   within UX UY partition
-          *(u64 *)(small0+small.index[uy]) = ((u64)edge << ZBITS) | (e & ZMASK);
+          small.put(small0, uy, ((u64)edge << ZBITS) | (e & ZMASK), SMALLSIZE);
 // printf("id %d ux %d y %d e %010lx e' %010x\n", id, ux, my, e, ((u64)edge << ZBITS) | (e >> YBITS));
-          small.index[uy] += SMALLSIZE;
         }
         if (unlikely(edge >> NONYZBITS != (((my+1) << YZBITS) - 1) >> NONYZBITS))
-        { printf("OOPS1: id %d ux %d y %d edge %x vs %x\n", id, ux, my, edge, ((my+1)<<YZBITS)-1); exit(0); }
+          OOPS("OOPS1: id %d ux %d y %d edge %x vs %x\n", id, ux, my, edge, ((my+1)<<YZBITS)-1);
       }
       u8 *degs = tdegs[id];
       small.storeu(tbuckets+id, 0);
@@ -567,6 +936,7 @@ public:
         u32 *edges0 = tedges[id];
 #endif
         u32 *edges = edges0, edge = 0;
+        u32 *kills = KILLS ? tkills + id * TBUCKETSLOTS : 0, *kill = kills;
         for (u8 *rdsmall = readsmall; rdsmall < endreadsmall; rdsmall+=SMALLSIZE) {
 // bit         39..13     12..0
 // read          edge     UZZZZ    sorted by UY within UX partition
@@ -574,15 +944,22 @@ public:
           edge += ((e >> ZBITS) - edge) & NONDEGMASK;
 // if (id==0) printf("id %d ux %d uy %d e %010lx pref %4x edge %x mask %x\n", id, ux, uy, e, e>>ZBITS, edge, NONDEGMASK);
           *edges = edge;
+          if (KILLS)
+            *kill = edge;
           const u32 z = e & ZMASK;
           *zs = z;
           const u32 delta = degs[z ^ 1];
           edges += delta;
           zs    += delta;
+          if (KILLS)
+            kill += delta ^ 1;
         }
         if (unlikely(edge >> NONDEGBITS != EDGEMASK >> NONDEGBITS))
-        { printf("OOPS2: id %d ux %d uy %d edge %x vs %x\n", id, ux, uy, edge, EDGEMASK); exit(0); }
-        assert(edges - edges0 < NTRIMMEDZ);
+          OOPS("OOPS2: id %d ux %d uy %d edge %x vs %x\n", id, ux, uy, edge, EDGEMASK);
+        if (unlikely(edges - edges0 >= NTRIMMEDZ)) // more than a SAVEEDGES bucket holds
+          OOPS("OOPS5: id %d ux %d uy %d %d edges vs %d\n", id, ux, uy, (int)(edges - edges0), NTRIMMEDZ);
+        if (KILLS)
+          killedges(kills, kill);
         const u16 *readz = tzs[id];
         const u32 *readedge = edges0;
         int64_t uy34 = (int64_t)uy << YZZBITS;
@@ -595,9 +972,9 @@ public:
           v6 = v2 = _mm_set1_epi64x(sip_keys.k2);
           v7 = v3 = _mm_set1_epi64x(sip_keys.k3);
 
-          vpacket0 = _mm_slli_epi64(_mm_cvtepu32_epi64(*(__m128i*) readedge     ), 1) | vuorv;
+          vpacket0 = _mm_slli_epi64(_mm_cvtepu32_epi64(_mm_loadl_epi64((__m128i*) readedge     )), 1) | vuorv;
           vhi0     = vuy34 | _mm_slli_epi64(_mm_cvtepu16_epi64(_mm_set_epi64x(0,*(u64*)readz)), YZBITS);
-          vpacket1 = _mm_slli_epi64(_mm_cvtepu32_epi64(*(__m128i*)(readedge + 2)), 1) | vuorv;
+          vpacket1 = _mm_slli_epi64(_mm_cvtepu32_epi64(_mm_loadl_epi64((__m128i*)(readedge + 2))), 1) | vuorv;
           vhi1     = vuy34 | _mm_slli_epi64(_mm_cvtepu16_epi64(_mm_set_epi64x(0,*(u64*)(readz + 2))), YZBITS);
 
           v3 = XOR(v3,vpacket0); v7 = XOR(v7,vpacket1);
@@ -617,8 +994,7 @@ public:
           u32 vx;
 #define STORE(i,v,x,w) \
   vx = extract32(v,x);\
-  *(u64 *)(base+dst.index[vx]) = _mm_extract_epi64(w,i%2);\
-  dst.index[vx] += BIGSIZE;
+  dst.put(base, vx, (u64)_mm_extract_epi64(w,i%2), BIGSIZE);
           STORE(0,v1,0,v0); STORE(1,v1,2,v0);
           STORE(2,v5,0,v4); STORE(3,v5,2,v4);
         }
@@ -653,31 +1029,265 @@ public:
           u32 vx;
 #define STORE(i,v,x,w) \
   vx = _mm256_extract_epi32(v,x);\
-  *(u64 *)(base+dst.index[vx]) = _mm256_extract_epi64(w,i%4);\
-  dst.index[vx] += BIGSIZE;
+  dst.put(base, vx, (u64)_mm256_extract_epi64(w,i%4), BIGSIZE);
 // printf("Id %d ux %d y %d edge %08x e' %010lx vx %d\n", id, ux, uy, readedge[i], _mm256_extract_epi64(w,i%4), vx);
 
           STORE(0,v1,0,v0); STORE(1,v1,2,v0); STORE(2,v1,4,v0); STORE(3,v1,6,v0);
           STORE(4,v5,0,v4); STORE(5,v5,2,v4); STORE(6,v5,4,v4); STORE(7,v5,6,v4);
         }
+#elif NSIPHASH >= 16
+        for (; readedge <= edges-NSIPHASH; readedge += NSIPHASH, readz += NSIPHASH) {
+          for (u32 i = 0; i < NSIPHASH; i++)
+            indices[i] = 2 * (u64)readedge[i] + uorv;
+          siphash24xN(&sip_keys, indices, hashes);
+          for (u32 i = 0; i < NSIPHASH; i++) {
+            const u32 node = hashes[i] & EDGEMASK;
+            const u32 vx = node >> YZBITS;
+            dst.put(base, vx, (u64)(uy34 | ((u64)readz[i] << YZBITS) | (node & YZMASK)), BIGSIZE);
+          }
+        }
 #endif
-        for (; readedge < edges; readedge++, readz++) { // process up to 7 leftover edges if NSIPHASH==8
+        for (; readedge < edges; readedge++, readz++) { // process up to NSIPHASH-1 leftover edges
           const u32 node = sipnode(&sip_keys, *readedge, uorv);
           const u32 vx = node >> YZBITS; // & XMASK;
 // bit        39..34    33..21     20..13     12..0
 // write      UYYYYY    UZZZZZ     VYYYYY     VZZZZ   within VX partition
-          *(u64 *)(base+dst.index[vx]) = uy34 | ((u64)*readz << YZBITS) | (node & YZMASK);
+          dst.put(base, vx, (u64)(uy34 | ((u64)*readz << YZBITS) | (node & YZMASK)), BIGSIZE);
 // printf("id %d ux %d y %d edge %08x e' %010lx vx %d\n", id, ux, uy, *readedge, uy34 | ((u64)(node & YZMASK) << ZBITS) | *readz, vx);
-          dst.index[vx] += BIGSIZE;
         }
       }
       sumsize += dst.storeu(buckets, ux);
     }
-    rdtsc1 = __rdtsc();
-    if (!id) printf("genVnodes round %2d size %u rdtsc: %lu\n", uorv, sumsize/BIGSIZE, rdtsc1-rdtsc0);
+    stats.record(round, id, "genVnodes", timer, sumsize/BIGSIZE, readsize, sumsize);
+    stats.at(round, id).spills = dst.nspills;
     tcounts[id] = sumsize/BIGSIZE;
   }
 
+  // in sliced rounds, only the bucket rows of one slice at a time are kept,
+  // each row using the matrix memory of several, so that a matrix sized for
+  // a fraction MATRIXFRAC of edges can hold all edges of that slice. which
+  // edges survive is kept in the alive bitmap instead, with the edges in the
+  // buckets of a round going through the slices for no more than to be counted
+  static u32 slicerows(const u32 k) {
+    return (NX + k-1) / k;
+  }
+  // buckets of the matrix spanned by one bucket of a sliced round
+  static u32 slicewidth(const u32 k) {
+    return NX / slicerows(k);
+  }
+  static u32 spanbytes(const u32 width) {
+    return (width-1) * sizeof(zbucket<ZBUCKETSIZE>) + ZBUCKETSIZE;
+  }
+  // fewest slices for which the buckets of round 0 fit as well as in a full matrix
+  static u32 minslices() {
+    u32 k;
+    for (k = 1; k < NX && slicewidth(k) * (u64)ZBUCKETSLOTS < NZ + NZ * BIGEPS; k++) ;
+    return k;
+  }
+  // edges left after sliced rounds that the matrix can take, leaving margin
+  // for the syncing entries of sparse buckets
+  static u64 mergeedges() {
+    const u64 fit = (u64)NX * NY * (NZ * MATRIXFRAC);
+    return fit - fit/8;
+  }
+  // keep the alive bitmap up to date through genVnodes, the last round to
+  // see edge indices, even without slicing (see solver_ctx::matchAlive)
+  void keepalive() {
+    if (!alive) {
+      alive = new std::atomic<u64>[NEDGES/64];
+      tkills = new u32[nthreads * TBUCKETSLOTS];
+    }
+  }
+  void slice(const u32 k) {
+    slices = k;
+    if (k)
+      keepalive();
+  }
+  u64 alivebytes() const {
+    return alive ? NEDGES/8 : 0;
+  }
+  // bucket of row i in the slice, holding edges of block my
+  zbucket<ZBUCKETSIZE> &slicebucket(const u32 i, const u32 my, const u32 width) const {
+    const u32 b = (i * NY + my) * width;
+    return buckets[b / NY][b % NY];
+  }
+  // all edges start out alive; each thread sets the bits of its own blocks,
+  // the only ones it reads in round 0, or ahead of genVnodes
+  void resetalive(const u32 id) {
+    const u32 starty = NY *  id    / nthreads;
+    const u32   endy = NY * (id+1) / nthreads;
+    for (u64 w = (u64)starty * NYZ/64; w < (u64)endy * NYZ/64; w++)
+      alive[w].store(~0ULL, std::memory_order_relaxed);
+  }
+  // put those of n hashed edges whose node is in rows x0 up to x1. picking
+  // them out first keeps the unpredictable test out of the branches
+  void putslice(indexer<ZBUCKETSIZE> &dst, u8 const *base, u32 *last, const u32 x0, const u32 x1,
+                const u32 *edges, const u64 *hashes, const u32 n) {
+    u32 picks[NSIPHASH], npicks = 0;
+    for (u32 i = 0; i < n; i++) {
+      picks[npicks] = i;
+      npicks += ((hashes[i] & EDGEMASK) >> YZBITS) - x0 < x1 - x0;
+    }
+    for (u32 j = 0; j < npicks; j++) {
+      const u32 edge = edges[picks[j]], node = hashes[picks[j]] & EDGEMASK;
+      const u32 ux = node >> YZBITS;
+      const BIGTYPE0 zz = (BIGTYPE0)edge << YZBITS | (node & YZMASK);
+#ifndef NEEDSYNC
+      dst.put(base, ux, zz, BIGSIZE0);
+#else
+      if (likely((u32)zz)) {
+        for (; unlikely(last[ux] + NNONYZ <= edge); last[ux] += NNONYZ)
+          dst.put(base, ux, (u32)0, BIGSIZE0);
+        dst.put(base, ux, (u32)zz, BIGSIZE0);
+        last[ux] = edge;
+      }
+#endif
+    }
+  }
+  // genUnodes for just the edges alive, and with a node on side uorv in
+  // bucket rows x0 up to x1, each spanning width buckets; returns entries written
+  u64 genSlice(const u32 id, const u32 uorv, const u32 round, const u32 x0, const u32 x1, const u32 width) {
+    u32 last[NX];
+    alignas(64) u64 indices[NSIPHASH];
+    alignas(64) u64 hashes[NSIPHASH];
+    u32 edges[NSIPHASH];
+    const phasetimer timer;
+    u8 const *base = (u8 *)buckets;
+    indexer<ZBUCKETSIZE> dst(&failed, &spills, round);
+    dst.span = spanbytes(width);
+    const u32 starty = NY *  id    / nthreads;
+    const u32   endy = NY * (id+1) / nthreads;
+    offset_t sumsize = 0;
+    for (u32 my = starty; my < endy && !cancelling(); my++) {
+      const u32 startedge = my << YZBITS, endedge = startedge + NYZ;
+      for (u32 x = x0; x < x1; x++) {
+        dst.open(x, slicebucket(x-x0, my, width).bytes - base);
+        last[x] = startedge;
+      }
+      u32 n = 0;
+      for (u32 edge = startedge; edge < endedge; edge += 64) {
+        for (u64 bits = alive[edge/64].load(std::memory_order_relaxed); bits; bits &= bits-1) {
+          edges[n] = edge + __builtin_ctzll(bits);
+          indices[n] = 2 * (u64)edges[n] + uorv;
+          if (++n == NSIPHASH) {
+            siphash24xN(&sip_keys, indices, hashes);
+            putslice(dst, base, last, x0, x1, edges, hashes, n);
+            n = 0;
+          }
+        }
+      }
+      for (u32 i = 0; i < n; i++) // up to NSIPHASH-1 leftover edges
+        hashes[i] = sipnode(&sip_keys, edges[i], uorv);
+      putslice(dst, base, last, x0, x1, edges, hashes, n);
+#ifdef NEEDSYNC
+      for (u32 x = x0; x < x1; x++)
+        for (; last[x] < endedge-NNONYZ; last[x] += NNONYZ)
+          dst.put(base, x, (u32)0, BIGSIZE0);
+#endif
+      for (u32 x = x0; x < x1; x++)
+        sumsize += dst.store(slicebucket(x-x0, my, width), base, x);
+    }
+    phasestats &ps = stats.at(round, id);
+    trimmetrics::stop(ps, timer);
+    ps.byteswritten += sumsize;
+    ps.spills += dst.nspills;
+    return sumsize/BIGSIZE0;
+  }
+  // clear the alive bits of the edges from kills up to end. they are all
+  // over the bitmap, so get many cache misses going at once
+  void killedges(const u32 *kills, const u32 *end) {
+    static const u32 KILLAHEAD = 16;
+    for (const u32 *k = kills; k < end; k++) {
+      if (k + KILLAHEAD < end)
+        __builtin_prefetch(&alive[k[KILLAHEAD]/64], 1);
+      alive[*k/64].fetch_and(~(1ULL << (*k%64)), std::memory_order_relaxed);
+    }
+  }
+  // the trimming half of a sliced round, sorting the rows of a slice on Y
+  // and counting Z as genVnodes does, but rather than hashing the survivors
+  // onward, clearing the alive bits of the edges trimmed
+  void trimSlice(const u32 id, const u32 round, const u32 x0, const u32 x1, const u32 width) {
+    static const u32 NONDEGBITS = std::min(BIGSLOTBITS, 2 * YZBITS) - ZBITS;
+    static const u32 NONDEGMASK = (1 << NONDEGBITS) - 1;
+    indexer<TBUCKETSIZE> small(&failed);
+    const phasetimer timer;
+    offset_t readsize = 0;
+    u64 nalive = 0;
+    u8 const *base = (u8 *)buckets;
+    u8 const *small0 = (u8 *)tbuckets[id];
+    const u32 startx = x0 + (x1-x0) *  id    / nthreads;
+    const u32   endx = x0 + (x1-x0) * (id+1) / nthreads;
+    for (u32 ux = startx; ux < endx && !cancelling(); ux++) {
+      small.matrixu(0);
+      for (u32 my = 0 ; my < NY; my++) {
+        u32 edge = my << YZBITS;
+        const zbucket<ZBUCKETSIZE> &zb = slicebucket(ux-x0, my, width);
+        const u8 *readbig = zb.bytes, *endreadbig = readbig + zb.size;
+        readsize += zb.size + zb.spilled;
+        for (; zb.more(base, readbig, endreadbig); readbig += BIGSIZE0) {
+          BIGTYPE0 e = *(BIGTYPE0 *)readbig;
+#if BIGSIZE0 > 4
+          e &= BIGSLOTMASK0;
+#elif defined NEEDSYNC
+          if (unlikely(!e)) { edge += NNONYZ; continue; }
+#endif
+          edge += ((u32)(e >> YZBITS) - edge) & (NNONYZ-1);
+          const u32 uy = (e >> ZBITS) & YMASK;
+          small.put(small0, uy, ((u64)edge << ZBITS) | (e & ZMASK), SMALLSIZE);
+        }
+      }
+      u8 *degs = tdegs[id];
+      small.storeu(tbuckets+id, 0);
+      for (u32 uy = 0 ; uy < NY; uy++) {
+        memset(degs, 0, NZ);
+        u8 *readsmall = tbuckets[id][uy].bytes, *endreadsmall = readsmall + tbuckets[id][uy].size;
+        for (u8 *rdsmall = readsmall; rdsmall < endreadsmall; rdsmall+=SMALLSIZE)
+          degs[*(u32 *)rdsmall & ZMASK] = 1;
+        u32 *kills = tkills + id * TBUCKETSLOTS, *kill = kills, edge = 0;
+        for (u8 *rdsmall = readsmall; rdsmall < endreadsmall; rdsmall+=SMALLSIZE) {
+          const u64 e = *(u64 *)rdsmall;
+          edge += ((e >> ZBITS) - edge) & NONDEGMASK;
+          *kill = edge;
+          kill += !degs[(e & ZMASK) ^ 1];
+        }
+        nalive += (endreadsmall - readsmall) / SMALLSIZE - (kill - kills);
+        killedges(kills, kill);
+      }
+    }
+    phasestats &ps = stats.at(round, id);
+    trimmetrics::stop(ps, timer);
+    ps.edges += nalive;
+    ps.bytesread += readsize;
+  }
+  // trim side uorv of the alive edges, one slice of bucket rows at a time,
+  // or return false on being cancelled
+  bool slicetrim(const u32 id, const u32 uorv, const u32 round) {
+    const u32 rows = slicerows(slices), width = slicewidth(slices);
+    if (!id)
+      stats.phases[round] = uorv ? "sliceVnodes" : "sliceUnodes";
+    for (u32 x0 = 0; x0 < NX; x0 += rows) {
+      const u32 x1 = std::min(x0 + rows, NX);
+      genSlice(id, uorv, round, x0, x1, width);
+      if (!barrier(id, round))
+        return false;
+      trimSlice(id, round, x0, x1, width);
+      if (x1 < NX) {
+        // the spill chunks of this slice were read; let the next claim them
+        if (!id)
+          spills.claims[round].store(0, std::memory_order_relaxed);
+        if (!barrier(id, round))
+          return false;
+      }
+    }
+    return true;
+  }
+  // genUnodes after sliced rounds, filling the whole matrix with the survivors
+  void genAlive(const u32 id, const u32 round) {
+    tcounts[id] = stats.at(round, id).edges = genSlice(id, 0, round, 0, NX, 1);
+    if (!id)
+      stats.phases[round] = "genUnodes";
+  }
+
   template <u32 SRCSIZE, u32 DSTSIZE, bool TRIMONV>
   void trimedges(const u32 id, const u32 round) {
     const u32 SRCSLOTBITS = std::min(SRCSIZE * 8, 2 * YZBITS);
@@ -688,24 +1298,22 @@ public:
     const u64 DSTSLOTMASK = (1ULL << DSTSLOTBITS) - 1ULL;
     const u32 DSTPREFBITS = DSTSLOTBITS - YZZBITS;
     const u32 DSTPREFMASK = (1 << DSTPREFBITS) - 1;
-    u64 rdtsc0, rdtsc1;
-    indexer<ZBUCKETSIZE> dst;
-    indexer<TBUCKETSIZE> small;
+    bigindexer<ZBUCKETSIZE> dst(&failed, &spills, round);
+    indexer<TBUCKETSIZE> small(&failed);
   
-    rdtsc0 = __rdtsc();
-    offset_t sumsize = 0;
+    const phasetimer timer;
+    offset_t sumsize = 0, readsize = 0;
     u8 const *base = (u8 *)buckets;
     u8 const *small0 = (u8 *)tbuckets[id];
-    const u32 startvx = NY *  id    / nthreads;
-    const u32   endvx = NY * (id+1) / nthreads;
-    for (u32 vx = startvx; vx < endvx; vx++) {
+    for (u32 vx = firstcolumn(id, round); vx < NY; vx = nextcolumn(id, round, vx)) {
       small.matrixu(0);
       for (u32 ux = 0 ; ux < NX; ux++) {
         u32 uxyz = ux << YZBITS;
         zbucket<ZBUCKETSIZE> &zb = TRIMONV ? buckets[ux][vx] : buckets[vx][ux];
+        readsize += zb.size + zb.spilled;
         const u8 *readbig = zb.bytes, *endreadbig = readbig + zb.size;
 // printf("id %d vx %d ux %d size %u\n", id, vx, ux, zb.size/SRCSIZE);
-        for (; readbig < endreadbig; readbig += SRCSIZE) {
+        for (; zb.more(base, readbig, endreadbig); readbig += SRCSIZE) {
 // bit        43..37    36..22     21..15     14..0
 // write      UYYYYY    UZZZZZ     VYYYYY     VZZZZ   within VX partition
           const u64 e = *(u64 *)readbig & SRCSLOTMASK;
@@ -714,12 +1322,11 @@ public:
           const u32 vy = (e >> ZBITS) & YMASK;
 // bit     43/39..37    36..30     29..15     14..0
 // write      UXXXXX    UYYYYY     UZZZZZ     VZZZZ   within VX VY partition
-          *(u64 *)(small0+small.index[vy]) = ((u64)uxyz << ZBITS) | (e & ZMASK);
+          small.put(small0, vy, ((u64)uxyz << ZBITS) | (e & ZMASK), DSTSIZE);
           uxyz &= ~ZMASK;
-          small.index[vy] += DSTSIZE;
         }
         if (unlikely(uxyz >> YZBITS != ux))
-        { printf("OOPS3: id %d vx %d ux %d UXY %x\n", id, vx, ux, uxyz); exit(0); }
+          OOPS("OOPS3: id %d vx %d ux %d UXY %x\n", id, vx, ux, uxyz);
       }
       u8 *degs = tdegs[id];
       small.storeu(tbuckets+id, 0);
@@ -740,17 +1347,15 @@ public:
 // printf("id %d vx %d vy %d e %010lx suffUX %02x UX %x mask %x\n", id, vx, vy, e, (u32)(e >> YZZBITS), ux, SRCPREFMASK);
 // bit    41/39..34    33..21     20..13     12..0
 // write     VYYYYY    VZZZZZ     UYYYYY     UZZZZ   within UX partition
-          *(u64 *)(base+dst.index[ux]) = vy34 | ((e & ZMASK) << YZBITS) | ((e >> ZBITS) & YZMASK);
-          dst.index[ux] += degs[(e & ZMASK) ^ 1];
+          dst.put(base, ux, vy34 | ((e & ZMASK) << YZBITS) | ((e >> ZBITS) & YZMASK), degs[(e & ZMASK) ^ 1]);
         }
         if (unlikely(ux >> DSTPREFBITS != XMASK >> DSTPREFBITS))
-        { printf("OOPS4: id %d vx %x ux %x vs %x\n", id, vx, ux, XMASK); }
+        { if (!QUIET) printf("OOPS4: id %d vx %x ux %x vs %x\n", id, vx, ux, XMASK); }
       }
       sumsize += TRIMONV ? dst.storev(buckets, vx) : dst.storeu(buckets, vx);
     }
-    rdtsc1 = __rdtsc();
-    if (showall || (!id && !(round & (round+1))))
-      printf("trimedges id %d round %2d size %u rdtsc: %lu\n", id, round, sumsize/DSTSIZE, rdtsc1-rdtsc0);
+    stats.record(round, id, "trimedges", timer, sumsize/DSTSIZE, readsize, sumsize);
+    stats.at(round, id).spills = dst.nspills;
     tcounts[id] = sumsize/DSTSIZE;
   }
 
@@ -762,25 +1367,23 @@ public:
     const u32 SRCPREFMASK = (1 << SRCPREFBITS) - 1;
     const u32 SRCPREFBITS2 = SRCSLOTBITS - YZZBITS;
     const u32 SRCPREFMASK2 = (1 << SRCPREFBITS2) - 1;
-    u64 rdtsc0, rdtsc1;
-    indexer<ZBUCKETSIZE> dst;
-    indexer<TBUCKETSIZE> small;
+    indexer<ZBUCKETSIZE> dst(&failed);
+    indexer<TBUCKETSIZE> small(&failed);
     u32 maxnnid = 0;
   
-    rdtsc0 = __rdtsc();
-    offset_t sumsize = 0;
+    const phasetimer timer;
+    offset_t sumsize = 0, readsize = 0;
     u8 const *base = (u8 *)buckets;
     u8 const *small0 = (u8 *)tbuckets[id];
-    const u32 startvx = NY *  id    / nthreads;
-    const u32   endvx = NY * (id+1) / nthreads;
-    for (u32 vx = startvx; vx < endvx; vx++) {
+    for (u32 vx = firstcolumn(id, round); vx < NY; vx = nextcolumn(id, round, vx)) {
       small.matrixu(0);
       for (u32 ux = 0 ; ux < NX; ux++) {
         u32 uyz = 0;
         zbucket<ZBUCKETSIZE> &zb = TRIMONV ? buckets[ux][vx] : buckets[vx][ux];
+        readsize += zb.size + zb.spilled;
         const u8 *readbig = zb.bytes, *endreadbig = readbig + zb.size;
 // printf("id %d vx %d ux %d size %u\n", id, vx, ux, zb.size/SRCSIZE);
-        for (; readbig < endreadbig; readbig += SRCSIZE) {
+        for (; zb.more(base, readbig, endreadbig); readbig += SRCSIZE) {
 // bit        39..37    36..22     21..15     14..0
 // write      UYYYYY    UZZZZZ     VYYYYY     VZZZZ   within VX partition  if TRIMONV
 // bit            37...22     21..15     14..0
@@ -795,11 +1398,10 @@ public:
 // write      UXXXXX    UYYYYY     UZZZZZ     VZZZZ   within VX VY partition  if TRIMONV
 // bit            37...31     30...15     14..0
 // write          VXXXXXX     VYYYZZ'     UZZZZ   within UX UY partition  if !TRIMONV
-          *(u64 *)(small0+small.index[vy]) = ((u64)(ux << (TRIMONV ? YZBITS : YZ1BITS) | uyz) << ZBITS) | (e & ZMASK);
+          small.put(small0, vy, ((u64)(ux << (TRIMONV ? YZBITS : YZ1BITS) | uyz) << ZBITS) | (e & ZMASK), SRCSIZE);
 // if (TRIMONV&&vx==75&&vy==83) printf("id %d vx %d vy %d e %010lx e15 %x ux %x\n", id, vx, vy, ((u64)uxyz << ZBITS) | (e & ZMASK), uxyz, uxyz>>YZBITS);
           if (TRIMONV)
             uyz &= ~ZMASK;
-          small.index[vy] += SRCSIZE;
         }
       }
       u8 *degs = tdegs[id];
@@ -841,43 +1443,103 @@ public:
 // bit       37..22     21..15     14..0
 // write     VYYZZ'     UYYYYY     UZZZZ   within UX partition  if TRIMONV
             if (TRIMONV)
-                 *(u64 *)(base+dst.index[ux]) = ((u64)(newnodeid + vdeg) << YZBITS ) | ((e >> ZBITS) & YZMASK);
-            else *(u32 *)(base+dst.index[ux]) = (     (newnodeid + vdeg) << YZ1BITS) | ((e >> ZBITS) & YZ1MASK);
+                 dst.put(base, ux, ((u64)(newnodeid + vdeg) << YZBITS ) | ((e >> ZBITS) & YZMASK), DSTSIZE);
+            else dst.put(base, ux, (u32)((newnodeid + vdeg) << YZ1BITS | ((e >> ZBITS) & YZ1MASK)), DSTSIZE);
 // if (vx==44&&vy==58) printf("  id %d vx %d vy %d newe %010lx\n", id, vx, vy, vy28 | ((vdeg) << YZBITS) | ((e >> ZBITS) & YZMASK));
-            dst.index[ux] += DSTSIZE;
           }
         }
         newnodeid += 2 * nrenames;
         if (TRIMONV && unlikely(ux >> SRCPREFBITS2 != XMASK >> SRCPREFBITS2))
-        { printf("OOPS6: id %d vx %d vy %d ux %x vs %x\n", id, vx, vy, ux, XMASK); exit(0); }
+          OOPS("OOPS6: id %d vx %d vy %d ux %x vs %x\n", id, vx, vy, ux, XMASK);
       }
       if (newnodeid > maxnnid)
         maxnnid = newnodeid;
       sumsize += TRIMONV ? dst.storev(buckets, vx) : dst.storeu(buckets, vx);
     }
-    rdtsc1 = __rdtsc();
-    if (showall || !id) printf("trimrename id %d round %2d size %u rdtsc: %lu maxnnid %d\n", id, round, sumsize/DSTSIZE, rdtsc1-rdtsc0, maxnnid);
-    if (maxnnid >= NYZ1) printf("maxnnid %d >= NYZ1 %d\n", maxnnid, NYZ1);
+    stats.record(round, id, "trimrename", timer, sumsize/DSTSIZE, readsize, sumsize, maxnnid);
+    if (maxnnid >= NYZ1) OOPS("maxnnid %d >= NYZ1 %d\n", maxnnid, NYZ1);
     assert(maxnnid < NYZ1);
     tcounts[id] = sumsize/DSTSIZE;
   }
 
+#ifdef __AVX512F__
+  // the second half of trimedges1 for one bucket, 16 edges at a time:
+  // gather the marks of their partner nodes vyz^1, and compress-store
+  // the swapped survivors. the marking is left scalar; its bitmap of
+  // NYZ1 bits stays in L1 cache, unlike the byte per node it replaces
+  static u32 *keepmarked1(const u32 *marks, const u32 *read, const u32 *end, u32 *write) {
+    // maskz forms with all lanes set, since gcc 12 warns about the undefined
+    // vector the plain forms merge into
+    const __mmask16 all = 0xffff;
+    const __m512i yz1mask = _mm512_set1_epi32(YZ1MASK);
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i bitmask = _mm512_set1_epi32(31);
+    for (; read + 16 <= end; read += 16) {
+// bit       31...16     15...0
+// read      UYYZZZ'     VYYZZ'   within VX partition
+      const __m512i e = _mm512_loadu_si512((const __m512i *)read);
+      const __m512i vyz = _mm512_and_si512(e, yz1mask);
+      const __m512i partner = _mm512_xor_si512(vyz, one);
+      const __m512i words = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), all, _mm512_maskz_srli_epi32(all, partner, 5), marks, 4);
+      const __mmask16 alive = _mm512_test_epi32_mask(_mm512_maskz_srlv_epi32(all, words, _mm512_and_si512(partner, bitmask)), one);
+// bit       31...16     15...0
+// write     VYYZZZ'     UYYZZ'   within UX partition
+      const __m512i swapped = _mm512_or_si512(_mm512_maskz_slli_epi32(all, vyz, YZ1BITS), _mm512_maskz_srli_epi32(all, e, YZ1BITS));
+      _mm512_mask_compressstoreu_epi32(write, alive, swapped);
+      write += __builtin_popcount(alive);
+    }
+    for (; read < end; read++) {
+      const u32 vyz = *read & YZ1MASK, partner = vyz ^ 1;
+      *write = (vyz << YZ1BITS) | (*read >> YZ1BITS);
+      write += (marks[partner >> 5] >> (partner & 31)) & 1;
+    }
+    return write;
+  }
+#endif
+
   template <bool TRIMONV>
   void trimedges1(const u32 id, const u32 round) {
-    u64 rdtsc0, rdtsc1;
-    indexer<ZBUCKETSIZE> dst;
+    indexer<ZBUCKETSIZE> dst(&failed);
   
-    rdtsc0 = __rdtsc();
-    offset_t sumsize = 0;
+    const phasetimer timer;
+    offset_t sumsize = 0, readsize = 0;
     u8 *degs = tdegs[id];
     u8 const *base = (u8 *)buckets;
-    const u32 startvx = NY *  id    / nthreads;
-    const u32   endvx = NY * (id+1) / nthreads;
-    for (u32 vx = startvx; vx < endvx; vx++) {
+    for (u32 vx = firstcolumn(id, round); vx < NY; vx = nextcolumn(id, round, vx)) {
       TRIMONV ? dst.matrixv(vx) : dst.matrixu(vx);
+#ifdef __AVX512F__
+      u32 *marks = (u32 *)degs; // as bitmap, to be probed 16 at a time
+      memset(marks, 0, NYZ1/8);
+      for (u32 ux = 0 ; ux < NX; ux++) {
+        zbucket<ZBUCKETSIZE> &zb = TRIMONV ? buckets[ux][vx] : buckets[vx][ux];
+        readsize += zb.size;
+        u32 *readbig = zb.words, *endreadbig = readbig + zb.size/sizeof(u32);
+        for (; readbig < endreadbig; readbig++) {
+          const u32 vyz = *readbig & YZ1MASK;
+          marks[vyz >> 5] |= 1U << (vyz & 31);
+        }
+      }
+      for (u32 ux = 0 ; ux < NX; ux++) {
+        zbucket<ZBUCKETSIZE> &zb = TRIMONV ? buckets[ux][vx] : buckets[vx][ux];
+        readsize += zb.size;
+        u32 *readbig = zb.words, *endreadbig = readbig + zb.size/sizeof(u32);
+        // in pieces that fit the room left, as each keeps no more than it reads
+        while (readbig < endreadbig) {
+          const offset_t room = (dst.end[ux] - dst.index[ux]) / sizeof(u32);
+          if (unlikely(!room)) {
+            dst.overflow(ux);
+            continue;
+          }
+          u32 *endpiece = (offset_t)(endreadbig - readbig) > room ? readbig + room : endreadbig;
+          dst.index[ux] = (u8 *)keepmarked1(marks, readbig, endpiece, (u32 *)(base+dst.index[ux])) - base;
+          readbig = endpiece;
+        }
+      }
+#else
       memset(degs, 0, NYZ1);
       for (u32 ux = 0 ; ux < NX; ux++) {
         zbucket<ZBUCKETSIZE> &zb = TRIMONV ? buckets[ux][vx] : buckets[vx][ux];
+        readsize += zb.size;
         u32 *readbig = zb.words, *endreadbig = readbig + zb.size/sizeof(u32);
         // printf("id %d vx %d ux %d size %d\n", id, vx, ux, zb.size/SRCSIZE);
         for (; readbig < endreadbig; readbig++)
@@ -885,6 +1547,7 @@ public:
       }
       for (u32 ux = 0 ; ux < NX; ux++) {
         zbucket<ZBUCKETSIZE> &zb = TRIMONV ? buckets[ux][vx] : buckets[vx][ux];
+        readsize += zb.size;
         u32 *readbig = zb.words, *endreadbig = readbig + zb.size/sizeof(u32);
         for (; readbig < endreadbig; readbig++) {
 // bit       31...16     15...0
@@ -894,35 +1557,31 @@ public:
           // printf("id %d vx %d ux %d e %08lx vyz %04x uyz %04x\n", id, vx, ux, e, vyz, e >> YZ1BITS);
 // bit       31...16     15...0
 // write     VYYZZZ'     UYYZZ'   within UX partition
-          *(u32 *)(base+dst.index[ux]) = (vyz << YZ1BITS) | (e >> YZ1BITS);
-          dst.index[ux] += degs[vyz ^ 1];
+          dst.put(base, ux, (vyz << YZ1BITS) | (e >> YZ1BITS), degs[vyz ^ 1]);
         }
       }
+#endif
       sumsize += TRIMONV ? dst.storev(buckets, vx) : dst.storeu(buckets, vx);
     }
-    rdtsc1 = __rdtsc();
-    if (showall || (!id && !(round & (round+1))))
-      printf("trimedges1 id %d round %2d size %u rdtsc: %lu\n", id, round, sumsize/sizeof(u32), rdtsc1-rdtsc0);
+    stats.record(round, id, "trimedges1", timer, sumsize/sizeof(u32), readsize, sumsize);
     tcounts[id] = sumsize/sizeof(u32);
   }
 
   template <bool TRIMONV>
   void trimrename1(const u32 id, const u32 round) {
-    u64 rdtsc0, rdtsc1;
-    indexer<ZBUCKETSIZE> dst;
+    indexer<ZBUCKETSIZE> dst(&failed);
     u32 maxnnid = 0;
   
-    rdtsc0 = __rdtsc();
-    offset_t sumsize = 0;
+    const phasetimer timer;
+    offset_t sumsize = 0, readsize = 0;
     u8 *degs = tdegs[id];
     u8 const *base = (u8 *)buckets;
-    const u32 startvx = NY *  id    / nthreads;
-    const u32   endvx = NY * (id+1) / nthreads;
-    for (u32 vx = startvx; vx < endvx; vx++) {
+    for (u32 vx = firstcolumn(id, round); vx < NY; vx = nextcolumn(id, round, vx)) {
       TRIMONV ? dst.matrixv(vx) : dst.matrixu(vx);
       memset(degs, 0, NYZ1);
       for (u32 ux = 0 ; ux < NX; ux++) {
         zbucket<ZBUCKETSIZE> &zb = TRIMONV ? buckets[ux][vx] : buckets[vx][ux];
+        readsize += zb.size;
         u32 *readbig = zb.words, *endreadbig = readbig + zb.size/sizeof(u32);
         // printf("id %d vx %d ux %d size %d\n", id, vx, ux, zb.size/SRCSIZE);
         for (; readbig < endreadbig; readbig++)
@@ -933,6 +1592,7 @@ public:
       u32 *endrenames = renames + NZ2/2;
       for (u32 ux = 0 ; ux < NX; ux++) {
         zbucket<ZBUCKETSIZE> &zb = TRIMONV ? buckets[ux][vx] : buckets[vx][ux];
+        readsize += zb.size;
         u32 *readbig = zb.words, *endreadbig = readbig + zb.size/sizeof(u32);
         for (; readbig < endreadbig; readbig++) {
 // bit       31...16     15...0
@@ -954,8 +1614,7 @@ public:
             vdeg = ((vdeg-0x0102) << 1) | (vyz & 1); // preserve parity
 // bit       26...16     15...0
 // write     VYYZZZ"     UYYZZ'   within UX partition
-            *(u32 *)(base+dst.index[ux]) = (vdeg << (TRIMONV ? YZ1BITS : YZ2BITS)) | (e >> YZ1BITS);
-            dst.index[ux] += sizeof(u32);
+            dst.put(base, ux, (vdeg << (TRIMONV ? YZ1BITS : YZ2BITS)) | (e >> YZ1BITS), sizeof(u32));
           }
         }
       }
@@ -963,82 +1622,120 @@ public:
         maxnnid = 2*newnodepairid;
       sumsize += TRIMONV ? dst.storev(buckets, vx) : dst.storeu(buckets, vx);
     }
-    rdtsc1 = __rdtsc();
-    if (showall || !id) printf("trimrename1 id %d round %2d size %u rdtsc: %lu maxnnid %d\n", id, round, sumsize/sizeof(u32), rdtsc1-rdtsc0, maxnnid);
-    if (maxnnid >= NYZ2) printf("maxnnid %d >= NYZ2 %d\n", maxnnid, NYZ2);
+    stats.record(round, id, "trimrename1", timer, sumsize/sizeof(u32), readsize, sumsize, maxnnid);
+    if (maxnnid >= NYZ2) OOPS("maxnnid %d >= NYZ2 %d\n", maxnnid, NYZ2);
     assert(maxnnid < NYZ2);
     tcounts[id] = sumsize/sizeof(u32);
   }
 
+  static void trimworker(void *et, const u32 id) {
+    ((edgetrimmer *)et)->trimmer(id);
+  }
   void trim() {
-    if (nthreads == 1) {
-      trimmer(0);
-      return;
-    }
-    void *etworker(void *vp);
-    thread_ctx *threads = new thread_ctx[nthreads];
-    for (u32 t = 0; t < nthreads; t++) {
-      threads[t].id = t;
-      threads[t].et = this;
-      int err = pthread_create(&threads[t].thread, NULL, etworker, (void *)&threads[t]);
-      assert(err == 0);
-    }
-    for (u32 t = 0; t < nthreads; t++) {
-      int err = pthread_join(threads[t].thread, NULL);
-      assert(err == 0);
+    stats.reset();
+    resetclaims();
+    pool->run(trimworker, this);
+  }
+  // trim in the background; pool->wait() for completion
+  void starttrim() {
+    stats.reset();
+    resetclaims();
+    pool->launch(trimworker, this);
+  }
+  void adapt(const double ratio, const u64 target) {
+    adaptive = true;
+    minreduction = ratio;
+    targetedges = target;
+  }
+  // whether to follow round with the final renaming pair. all threads reach
+  // the same verdict, from per round statistics no longer being written
+  bool converged(const u32 round) const {
+    const u64 edges = stats.edges(round);
+    if (edges > ADAPTEDGES)
+      return false;
+    return edges <= targetedges || edges > (1.0 - minreduction) * stats.edges(round-2);
+  }
+  void resetclaims() {
+    failed.store(false, std::memory_order_relaxed);
+    haltbarrier.store(~0U, std::memory_order_relaxed);
+    for (u32 r = 0; r < ntrims; r++) {
+      claims[r].store(0, std::memory_order_relaxed);
+      spills.claims[r].store(0, std::memory_order_relaxed);
     }
-    delete[] threads;
   }
-  void barrier() {
+  // wait for all threads to finish round, accounting the time spent idle.
+  // false if the trim is to stop, as any thread saw it cancelled before the
+  // barrier. barriers are numbered in the order all threads pass them, and
+  // only a thread not yet past barrier n can set haltbarrier to n, so even
+  // a thread already waiting at barrier n+1 can't change the verdict on n
+  bool barrier(const u32 id, const u32 round) {
+    const u32 n = nbarriers[id]++;
+    if (cancelling() && haltbarrier.load(std::memory_order_relaxed) > n)
+      haltbarrier.store(n, std::memory_order_relaxed);
+    const u64 start = phasetimer::now();
     int rc = pthread_barrier_wait(&barry);
     assert(rc == 0 || rc == PTHREAD_BARRIER_SERIAL_THREAD);
+    stats.at(round, id).waitns += phasetimer::now() - start;
+    return haltbarrier.load(std::memory_order_relaxed) > n;
   }
-#ifdef EXPANDROUND
-#define BIGGERSIZE BIGSIZE+1
-#else
-#define BIGGERSIZE BIGSIZE
-#define EXPANDROUND COMPRESSROUND
-#endif
   void trimmer(u32 id) {
-    genUnodes(id, 0);
-    barrier();
-    genVnodes(id, 1);
-    for (u32 round = 2; round < ntrims-2; round += 2) {
-      barrier();
-      if (round < COMPRESSROUND) {
-        if (round < EXPANDROUND)
+    u32 round = 0;
+    nbarriers[id] = 0;
+    if (alive)
+      resetalive(id);
+    if (slices) {
+      for (;; round += 2) {
+        if (!slicetrim(id, 0, round) || !barrier(id, round))
+          return;
+        if (!slicetrim(id, 1, round+1) || !barrier(id, round+1))
+          return;
+        // another pair must still leave trimedges a round before expanding
+        if (stats.edges(round+1) <= mergeedges() || round+6 > expandround)
+          break;
+      }
+      round += 2;
+      genAlive(id, round);
+    } else genUnodes(id, 0);
+    if (!barrier(id, round))
+      return;
+    if (alive)
+      genVnodes<true>(id, 1, round+1);
+    else genVnodes<false>(id, 1, round+1);
+    for (round += 2; round < ntrims-2; round += 2) {
+      if (!barrier(id, round-1))
+        return;
+      if (adaptive && round > compressround+2 && converged(round-1))
+        break;
+      if (round < compressround) {
+        if (round < expandround)
           trimedges<BIGSIZE, BIGSIZE, true>(id, round);
-        else if (round == EXPANDROUND)
+        else if (round == expandround)
           trimedges<BIGSIZE, BIGGERSIZE, true>(id, round);
         else trimedges<BIGGERSIZE, BIGGERSIZE, true>(id, round);
-      } else if (round==COMPRESSROUND) {
+      } else if (round==compressround) {
         trimrename<BIGGERSIZE, BIGGERSIZE, true>(id, round);
       } else trimedges1<true>(id, round);
-      barrier();
-      if (round < COMPRESSROUND) {
-        if (round+1 < EXPANDROUND)
+      if (!barrier(id, round))
+        return;
+      if (round < compressround) {
+        if (round+1 < expandround)
           trimedges<BIGSIZE, BIGSIZE, false>(id, round+1);
-        else if (round+1 == EXPANDROUND)
+        else if (round+1 == expandround)
           trimedges<BIGSIZE, BIGGERSIZE, false>(id, round+1);
         else trimedges<BIGGERSIZE, BIGGERSIZE, false>(id, round+1);
-      } else if (round==COMPRESSROUND) {
+      } else if (round==compressround) {
         trimrename<BIGGERSIZE, sizeof(u32), false>(id, round+1);
       } else trimedges1<false>(id, round+1);
     }
-    barrier();
-    trimrename1<true >(id, ntrims-2);
-    barrier();
-    trimrename1<false>(id, ntrims-1);
+    if (!barrier(id, round-1))
+      return;
+    trimrename1<true >(id, round);
+    if (!barrier(id, round))
+      return;
+    trimrename1<false>(id, round+1);
   }
 };
 
-void *etworker(void *vp) {
-  thread_ctx *tp = (thread_ctx *)vp;
-  tp->et->trimmer(tp->id);
-  pthread_exit(NULL);
-  return 0;
-}
-
 #define NODEBITS (EDGEBITS + 1)
 
 // grow with cube root of size, hardly affected by trimming
@@ -1052,53 +1749,112 @@ int nonce_cmp(const void *a, const void *b) {
 
 typedef word_t proof[PROOFSIZE];
 
-// break circular reference with forward declaration
-class solver_ctx;
-
-typedef struct {
-  u32 id;
-  pthread_t thread;
-  solver_ctx *solver;
-} match_ctx;
+// what findcycles and recordedge need of a trimmed graph, copied out of
+// the bucket matrix so that the next nonce can be trimmed while this
+// graph is searched for cycles. much smaller than the matrix itself
+class residual {
+public:
+  alignas(64) siphash_keys sip_keys;
+  u32 nedges;
+  u32 *uvs;                // nedges (u,v) pairs as added to the cycle finding graph
+  renametables *renames;   // one per bucket
+  char *graphbytes;        // cycle finding graph can't share tbuckets with a running trim,
+                           // nor with too few threads' tbuckets to hold it
+
+  residual(const bool pipelined, const u64 nbytes, const bool owngraph) {
+    nedges   = 0;
+    uvs      = pipelined ? new u32[2 * MAXEDGES] : 0;
+    renames  = pipelined ? new renametables[NX * NY] : 0;
+    graphbytes = pipelined || owngraph ? new char[nbytes] : 0;
+  }
+  ~residual() {
+    delete[] uvs;
+    delete[] renames;
+    delete[] graphbytes;
+  }
+  u64 bytes(const u64 nbytes) const {
+    return sizeof(u32[2 * MAXEDGES]) + sizeof(renametables[NX * NY]) + nbytes;
+  }
+};
 
 class solver_ctx {
 public:
+  threadpool pool; // must precede trimmer, which runs on it
   edgetrimmer trimmer;
+  residual resid;  // allocates memory only in pipelined mode
   graph<word_t> cg;
+  trimmetrics metrics; // of the graph whose cycles were last searched
   bool showcycle;
+  bool pipelined;
+  bool quiet;      // of progress reports, as for solvers sharing stdout
   proof cycleus;
   proof cyclevs;
   std::bitset<NXY> uxymap;
   std::vector<word_t> sols; // concatanation of all proof's indices
 
-  solver_ctx(const u32 nthreads, const u32 n_trims, bool allrounds, bool show_cycle)
-    : trimmer(nthreads, n_trims, allrounds), 
-      cg(MAXEDGES, MAXEDGES, MAXSOLS, (char *)trimmer.tbuckets) {
-    assert(cg.bytes() <= sizeof(yzbucket<TBUCKETSIZE>[nthreads])); // check that graph cg can fit in tbucket's memory
+  // bytes of cycle finding graph memory, as computed by graph::bytes()
+  const static u64 GRAPHBYTES = sizeof(word_t[2*MAXEDGES]) + sizeof(graph<word_t>::link[2*MAXEDGES]);
+
+  solver_ctx(const u32 nthreads, const u32 n_trims, bool allrounds, bool show_cycle, bool pipelined, bool numa)
+    : pool(nthreads),
+      trimmer(&pool, n_trims, allrounds, numa),
+      resid(pipelined, GRAPHBYTES, GRAPHBYTES > sizeof(yzbucket<TBUCKETSIZE>[nthreads])),
+      cg(MAXEDGES, MAXEDGES, MAXSOLS, resid.graphbytes ? resid.graphbytes : (char *)trimmer.tbuckets),
+      metrics(nthreads, n_trims) {
+    assert(cg.bytes() == GRAPHBYTES);
+#ifdef SAVEEDGES
+    assert(!pipelined); // saved edges live in the buckets
+#endif
     showcycle = show_cycle;
+    this->pipelined = pipelined;
+    quiet = QUIET;
   }
   void setheadernonce(char* const headernonce, const u32 len, const u32 nonce) {
     ((u32 *)headernonce)[len/sizeof(u32)-1] = htole32(nonce); // place nonce at end
     setheader(headernonce, len, &trimmer.sip_keys);
     sols.clear();
   }
-  ~solver_ctx() {
+  // abandon the solve in progress, from another thread. trimming stops
+  // after the bucket column at hand, and solves return no solutions
+  // until uncancel()
+  void cancel() {
+    trimmer.cancelled.store(true, std::memory_order_relaxed);
+  }
+  void uncancel() {
+    trimmer.cancelled.store(false, std::memory_order_relaxed);
+  }
+  bool cancelled() const {
+    return trimmer.cancelling();
+  }
+  // per round and per thread statistics for the graph whose cycles were last searched
+  const trimmetrics &stats() const {
+    return metrics;
+  }
+  // keys of the graph whose cycles were last searched
+  siphash_keys *sipkeys() {
+    return pipelined ? &resid.sip_keys : &trimmer.sip_keys;
+  }
+  const renametables &renames(const u32 x, const u32 y) const {
+    return pipelined ? resid.renames[x * NY + y] : *(renametables *)trimmer.buckets[x][y].renameu1;
   }
   u64 sharedbytes() const {
-    return sizeof(matrix<ZBUCKETSIZE>);
+    return trimmer.bucketpages->bytes + trimmer.alivebytes();
   }
   u32 threadbytes() const {
-    return sizeof(thread_ctx) + sizeof(yzbucket<TBUCKETSIZE>) + sizeof(zbucket8) + sizeof(zbucket16) + sizeof(zbucket32);
+    return sizeof(threadpool::worker_ctx) + trimmer.tbucketpages->bytes / trimmer.nthreads + sizeof(zbucket8) + sizeof(zbucket16) + sizeof(zbucket32) + (trimmer.tkills ? sizeof(u32[TBUCKETSLOTS]) : 0);
+  }
+  u64 residualbytes() const {
+    return pipelined ? resid.bytes(GRAPHBYTES) : 0;
   }
   void recordedge(const u32 i, const u32 u1, const u32 v2) {
     const u32 ux = u1 >> YZ2BITS;
-    u32 uyz = trimmer.buckets[ux][(u1 >> Z2BITS) & YMASK].renameu1[(u1 & Z2MASK) >> 1] | (u1 & 1);
+    u32 uyz = renames(ux, (u1 >> Z2BITS) & YMASK).renameu1[(u1 & Z2MASK) >> 1] | (u1 & 1);
     const u32 v1 = v2 - MAXEDGES;
     const u32 vx = v1 >> YZ2BITS;
-    u32 vyz = trimmer.buckets[(v1 >> Z2BITS) & YMASK][vx].renamev1[(v1 & Z2MASK) >> 1] | (v1 & 1);
+    u32 vyz = renames((v1 >> Z2BITS) & YMASK, vx).renamev1[(v1 & Z2MASK) >> 1] | (v1 & 1);
 #if COMPRESSROUND > 0
-    uyz = trimmer.buckets[ux][uyz >> Z1BITS].renameu[(uyz & Z1MASK) >> 1] | (u1 & 1);
-    vyz = trimmer.buckets[vyz >> Z1BITS][vx].renamev[(vyz & Z1MASK) >> 1] | (v1 & 1);
+    uyz = renames(ux, uyz >> Z1BITS).renameu[(uyz & Z1MASK) >> 1] | (u1 & 1);
+    vyz = renames(vyz >> Z1BITS, vx).renamev[(vyz & Z1MASK) >> 1] | (v1 & 1);
 #endif
     const u32 u = cycleus[i] = (ux << YZBITS) | uyz;
     cyclevs[i] = (vx << YZBITS) | vyz;
@@ -1126,31 +1882,24 @@ public:
     // printf("\n");
     if (showcycle) {
 #ifndef SAVEEDGES
-      void *matchworker(void *vp);
-
       sols.resize(sols.size() + PROOFSIZE);
-      match_ctx *threads = new match_ctx[trimmer.nthreads];
-      for (u32 t = 0; t < trimmer.nthreads; t++) {
-        threads[t].id = t;
-        threads[t].solver = this;
-        int err = pthread_create(&threads[t].thread, NULL, matchworker, (void *)&threads[t]);
-        assert(err == 0);
-      }
-      for (u32 t = 0; t < trimmer.nthreads; t++) {
-        int err = pthread_join(threads[t].thread, NULL);
-        assert(err == 0);
-      }
+      pool.run(matchworker, this);
+      metrics.nmatch++;
+      if (!quiet)
+        metrics.printmatch(trimmer.showall);
 #endif
       qsort(&sols[sols.size()-PROOFSIZE], PROOFSIZE, sizeof(u32), nonce_cmp);
     }
   }
 
   void findcycles() {
-    u64 rdtsc0, rdtsc1;
-  
-    rdtsc0 = __rdtsc();
+    const phasetimer timer;
     cg.reset();
-    for (u32 vx = 0; vx < NX; vx++) {
+    cg.quiet = quiet;
+    if (pipelined) {
+      for (u32 i = 0; i < resid.nedges; i++)
+        cg.add_edge(resid.uvs[2*i], resid.uvs[2*i+1]);
+    } else for (u32 vx = 0; vx < NX; vx++) {
       for (u32 ux = 0 ; ux < NX; ux++) {
         zbucket<ZBUCKETSIZE> &zb = trimmer.buckets[ux][vx];
         u32 *readbig = zb.words, *endreadbig = readbig + zb.size/sizeof(u32);
@@ -1166,30 +1915,141 @@ public:
         }
       }
     }
-    for (u32 s=0; s < cg.nsols; s++) {
+    for (u32 s=0; s < cg.nsols && !cancelled(); s++) {
       solution(cg.sols[s]);
     }
-    rdtsc1 = __rdtsc();
-    printf("findcycles rdtsc: %lu\n", rdtsc1-rdtsc0);
+    trimmetrics::stop(metrics.findcycles, timer);
+    if (!quiet)
+      metrics.printfindcycles();
   }
 
   int solve() {
     assert((u64)CUCKOO_SIZE * sizeof(u32) <= trimmer.nthreads * sizeof(yzbucket<TBUCKETSIZE>));
+    assert(!pipelined);
     trimmer.trim();
+    takestats();
+    if (!cancelled() && !trimmer.failed) // the buckets can't be trusted
+      findcycles();
+    if (cancelled()) // possibly amid nonce recovery
+      sols.clear();
+    return sols.size() / PROOFSIZE;
+  }
+
+  // pipelined mode, where the pool trims the next nonce while the caller
+  // searches the residual of the previous one:
+  //   setheadernonce(n); starttrim();
+  //   for each n: endtrim(); setheadernonce(n+1); starttrim(); solveresidual();
+  void starttrim() {
+    assert(pipelined);
+    trimmer.starttrim();
+  }
+  void endtrim() {
+    pool.wait();
+    takestats();
+    pool.run(saveworker, this);
+    resid.sip_keys = trimmer.sip_keys;
+    u32 n = 0;
+    for (u32 vx = 0; vx < NX; vx++) {
+      for (u32 ux = 0 ; ux < NX; ux++) {
+        zbucket<ZBUCKETSIZE> &zb = trimmer.buckets[ux][vx];
+        u32 *readbig = zb.words, *endreadbig = readbig + zb.size/sizeof(u32);
+        assert(n + (endreadbig - readbig) <= MAXEDGES);
+        for (; readbig < endreadbig; readbig++, n++) {
+          const u32 e = *readbig;
+          resid.uvs[2*n  ] = (ux << YZ2BITS) | (e >> YZ2BITS);
+          resid.uvs[2*n+1] = (vx << YZ2BITS) | (e & YZ2MASK);
+        }
+      }
+    }
+    resid.nedges = n;
+  }
+  // collect statistics of a finished trim, leaving the trimmer free to start the next
+  void takestats() {
+    metrics.reset();
+    metrics.copyrounds(trimmer.stats);
+    if (quiet)
+      return;
+    metrics.printrounds(trimmer.showall);
+    metrics.printtotal();
+    metrics.printspills();
+    if (trimmer.nthreads > 1)
+      metrics.printwait();
+  }
+  static void saveworker(void *solver, const u32 id) {
+    ((solver_ctx *)solver)->saverenames(id);
+  }
+  void saverenames(const u32 id) {
+    const u32 startux = NX *  id    / trimmer.nthreads;
+    const u32   endux = NX * (id+1) / trimmer.nthreads;
+    for (u32 ux = startux; ux < endux; ux++)
+      for (u32 y = 0; y < NY; y++)
+        resid.renames[ux * NY + y] = *(renametables *)trimmer.buckets[ux][y].renameu1;
+  }
+  // find cycles in the residual saved by endtrim, while the pool may be trimming
+  // the next graph. recovering their nonces has to wait for the pool though
+  int solveresidual() {
+    sols.clear();
     findcycles();
     return sols.size() / PROOFSIZE;
   }
 
-  void *matchUnodes(match_ctx *mc) {
-    u64 rdtsc0, rdtsc1;
-  
-    rdtsc0 = __rdtsc();
-    const u32 starty = NY *  mc->id    / trimmer.nthreads;
-    const u32   endy = NY * (mc->id+1) / trimmer.nthreads;
+  static void matchworker(void *solver, const u32 id) {
+    solver_ctx *ctx = (solver_ctx *)solver;
+    // pipelined, the bitmap is already that of the next graph
+    if (ctx->trimmer.alive && !ctx->pipelined)
+      ctx->matchAlive(id);
+    else ctx->matchUnodes(id);
+  }
+
+  void matchedges(siphash_keys &sip_keys, const u32 *edges, const u64 *hashes, const u32 n) {
+    for (u32 i = 0; i < n; i++) {
+      const u32 u = hashes[i] & EDGEMASK;
+      if (uxymap[u >> ZBITS]) {
+        for (u32 j = 0; j < PROOFSIZE; j++) {
+          if (cycleus[j] == u && cyclevs[j] == sipnode(&sip_keys, edges[i], 1)) {
+            sols[sols.size()-PROOFSIZE + j] = edges[i];
+          }
+        }
+      }
+    }
+  }
+  // matchUnodes for only the edges still alive after genVnodes, which
+  // include all cycle edges. where sliced rounds or -b keep a bitmap of them,
+  // that is 1 bit per edge rather than SAVEEDGES' 32, and spares recovery
+  // the hashing of over a third of the edges, or of over 80% after slicing
+  void matchAlive(const u32 id) {
+    const phasetimer timer;
+    siphash_keys &sip_keys = trimmer.sip_keys;
+    alignas(64) u64 indices[NSIPHASH];
+    alignas(64) u64 hashes[NSIPHASH];
+    u32 edges[NSIPHASH], n = 0;
+    const u32 starty = NY *  id    / trimmer.nthreads;
+    const u32   endy = NY * (id+1) / trimmer.nthreads;
+    for (u64 w = (u64)starty * NYZ/64; w < (u64)endy * NYZ/64 && !cancelled(); w++) {
+      for (u64 bits = trimmer.alive[w].load(std::memory_order_relaxed); bits; bits &= bits-1) {
+        edges[n] = w * 64 + __builtin_ctzll(bits);
+        indices[n] = 2 * (u64)edges[n];
+        if (++n == NSIPHASH) {
+          siphash24xN(&sip_keys, indices, hashes);
+          matchedges(sip_keys, edges, hashes, n);
+          n = 0;
+        }
+      }
+    }
+    for (u32 i = 0; i < n; i++) // up to NSIPHASH-1 leftover edges
+      hashes[i] = sipnode(&sip_keys, edges[i], 0);
+    matchedges(sip_keys, edges, hashes, n);
+    trimmetrics::stop(metrics.match[id], timer);
+  }
+
+  void matchUnodes(const u32 id) {
+    const phasetimer timer;
+    siphash_keys &sip_keys = *sipkeys();
+    const u32 starty = NY *  id    / trimmer.nthreads;
+    const u32   endy = NY * (id+1) / trimmer.nthreads;
     u32 edge = starty << YZBITS, endedge = edge + NYZ;
   #if NSIPHASH == 4
     static const __m128i vnodemask = {EDGEMASK, EDGEMASK};
-    siphash_keys &sip_keys = trimmer.sip_keys;
     __m128i v0, v1, v2, v3, v4, v5, v6, v7;
     const u32 e2 = 2 * edge;
     __m128i vpacket0 = _mm_set_epi64x(e2+2, e2+0);
@@ -1197,22 +2057,27 @@ public:
     static const __m128i vpacketinc = {8, 8};
   #elif NSIPHASH == 8
     static const __m256i vnodemask = {EDGEMASK, EDGEMASK, EDGEMASK, EDGEMASK};
-    const __m256i vinit = _mm256_load_si256((__m256i *)&trimmer.sip_keys);
+    const __m256i vinit = _mm256_load_si256((__m256i *)&sip_keys);
     __m256i v0, v1, v2, v3, v4, v5, v6, v7;
     const u32 e2 = 2 * edge;
     __m256i vpacket0 = _mm256_set_epi64x(e2+6, e2+4, e2+2, e2+0);
     __m256i vpacket1 = _mm256_set_epi64x(e2+14, e2+12, e2+10, e2+8);
     static const __m256i vpacketinc = {16, 16, 16, 16};
+  #elif NSIPHASH >= 16
+    alignas(64) u64 indices[NSIPHASH];
+    alignas(64) u64 hashes[NSIPHASH];
+    for (u32 i = 0; i < NSIPHASH; i++)
+      indices[i] = 2 * (u64)(edge + i);
   #endif
-    for (u32 my = starty; my < endy; my++, endedge += NYZ) {
+    for (u32 my = starty; my < endy && !cancelled(); my++, endedge += NYZ) {
       for (; edge < endedge; edge += NSIPHASH) {
   // bit        28..21     20..13    12..0
   // node       XXXXXX     YYYYYY    ZZZZZ
   #if NSIPHASH == 1
-        const u32 nodeu = sipnode(&trimmer.sip_keys, edge, 0);
+        const u32 nodeu = sipnode(&sip_keys, edge, 0);
         if (uxymap[nodeu >> ZBITS]) {
           for (u32 j = 0; j < PROOFSIZE; j++) {
-            if (cycleus[j] == nodeu && cyclevs[j] == sipnode(&trimmer.sip_keys, edge, 1)) {
+            if (cycleus[j] == nodeu && cyclevs[j] == sipnode(&sip_keys, edge, 1)) {
               sols[sols.size()-PROOFSIZE + j] = edge;
             }
           }
@@ -1247,7 +2112,7 @@ public:
   if (uxymap[uxy]) {\
     u32 u = extract32(w,x);\
     for (u32 j = 0; j < PROOFSIZE; j++) {\
-      if (cycleus[j] == u && cyclevs[j] == sipnode(&trimmer.sip_keys, edge+i, 1)) {\
+      if (cycleus[j] == u && cyclevs[j] == sipnode(&sip_keys, edge+i, 1)) {\
         sols[sols.size()-PROOFSIZE + j] = edge + i;\
       }\
     }\
@@ -1282,28 +2147,32 @@ public:
   if (uxymap[uxy]) {\
     u32 u = _mm256_extract_epi32(w,x);\
     for (u32 j = 0; j < PROOFSIZE; j++) {\
-      if (cycleus[j] == u && cyclevs[j] == sipnode(&trimmer.sip_keys, edge+i, 1)) {\
+      if (cycleus[j] == u && cyclevs[j] == sipnode(&sip_keys, edge+i, 1)) {\
         sols[sols.size()-PROOFSIZE + j] = edge + i;\
       }\
     }\
   }
         MATCH(0,v1,0,v0); MATCH(1,v1,2,v0); MATCH(2,v1,4,v0); MATCH(3,v1,6,v0);
         MATCH(4,v5,0,v4); MATCH(5,v5,2,v4); MATCH(6,v5,4,v4); MATCH(7,v5,6,v4);
+  #elif NSIPHASH >= 16
+        siphash24xN(&sip_keys, indices, hashes);
+        for (u32 i = 0; i < NSIPHASH; i++)
+          indices[i] += 2 * NSIPHASH;
+        for (u32 i = 0; i < NSIPHASH; i++) {
+          const u32 u = hashes[i] & EDGEMASK;
+          if (uxymap[u >> ZBITS]) {
+            for (u32 j = 0; j < PROOFSIZE; j++) {
+              if (cycleus[j] == u && cyclevs[j] == sipnode(&sip_keys, edge+i, 1)) {
+                sols[sols.size()-PROOFSIZE + j] = edge + i;
+              }
+            }
+          }
+        }
   #else
   #error not implemented
   #endif
       }
     }
-    rdtsc1 = __rdtsc();
-    if (trimmer.showall || !mc->id) printf("matchUnodes id %d rdtsc: %lu\n", mc->id, rdtsc1-rdtsc0);
-    pthread_exit(NULL);
-    return 0;
+    trimmetrics::stop(metrics.match[id], timer);
   }
 };
-
-void *matchworker(void *vp) {
-  match_ctx *tp = (match_ctx *)vp;
-  tp->solver->matchUnodes(tp);
-  pthread_exit(NULL);
-  return 0;
-}
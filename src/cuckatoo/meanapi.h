@@ -0,0 +1,26 @@
+// Cuckatoo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2019 John Tromp
+
+// what libcuckatoo.cpp needs of each mean miner instance built for it,
+// as implemented by meanlib.cpp within the instance's namespace
+
+#ifndef INCLUDE_MEANAPI_H
+#define INCLUDE_MEANAPI_H
+
+#include <stdint.h>
+#include "libcuckatoo.h"
+
+typedef struct {
+  // a solver_ctx, or 0 if its memory could not be had
+  void *(*create)(uint32_t nthreads, uint32_t ntrims);
+  void (*destroy)(void *solver);
+  // solve header (of CUCKATOO_HEADERLEN bytes) with nonce, storing up to
+  // maxproofs verified proofs in edges and adding to stats. returns the
+  // number of proofs, or CUCKATOO_EFAILED or CUCKATOO_ECANCELED
+  int (*solve)(void *solver, char *header, uint32_t nonce, uint64_t *edges, uint32_t maxproofs, cuckatoo_stats *stats);
+  // from any thread, making solve return CUCKATOO_ECANCELED until uncancel
+  void (*cancel)(void *solver);
+  void (*uncancel)(void *solver);
+} meanapi;
+
+#endif // ifdef INCLUDE_MEANAPI_H
@@ -0,0 +1,54 @@
+// Cuckatoo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2019 John Tromp
+
+// one instance of the mean miner, for the EDGEBITS (and XBITS, NSIPHASH, ...)
+// it is compiled with, wrapped in namespace MEANINSTANCE so that instances
+// for many graph sizes can be linked into the single dispatching binary made
+// from dispatch.cpp, or with -DLIBCUCKATOO into libcuckatoo.so, which needs
+// meanlib.cpp's functions rather than main. every size keeps all its
+// constants compile-time.
+// system headers are included up front, outside the namespace, so that
+// their include guards keep them out of it
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <immintrin.h>
+#include <x86intrin.h>
+#ifndef __APPLE__
+#include <endian.h>
+#else
+#include <machine/endian.h>
+#include <libkern/OSByteOrder.h>
+#include "../apple/osx_barrier.h"
+#endif
+#include <atomic>
+#include <bitset>
+#include <new>
+#include <vector>
+#include "../crypto/blake2.h"
+#ifdef LIBCUCKATOO
+#include "meanapi.h"
+#endif
+
+#ifndef MEANINSTANCE
+#error "need -DMEANINSTANCE=<namespace> for this instance"
+#endif
+
+namespace MEANINSTANCE {
+#ifdef LIBCUCKATOO
+#include "meanlib.cpp"
+#else
+#include "mean.cpp"
+#endif
+}
@@ -0,0 +1,81 @@
+// Cuckatoo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2019 John Tromp
+
+// one instance's half of libcuckatoo: meanapi's functions on a solver_ctx,
+// built in place of mean.cpp's main by meaninst.cpp with -DLIBCUCKATOO,
+// which keeps mean.hpp from printing or exiting
+
+#include "mean.hpp"
+
+void *create(const u32 nthreads, u32 ntrims) {
+  ntrims = ntrims ? ntrims & -2 : EDGEBITS > 30 ? 96 : 68; // as in mean.cpp
+  if (!nthreads || (COMPRESSROUND && COMPRESSROUND >= ntrims-2))
+    return 0;
+  void *mem;
+  // solver_ctx holds aligned keys, which plain new need not honour
+  if (posix_memalign(&mem, 64, sizeof(solver_ctx)))
+    return 0;
+  try {
+    return new (mem) solver_ctx(nthreads, ntrims, false, true, false, false);
+  } catch (const std::bad_alloc &) {
+    free(mem);
+    return 0;
+  }
+}
+
+void destroy(void *solver) {
+  ((solver_ctx *)solver)->~solver_ctx();
+  free(solver);
+}
+
+int solve(void *solver, char *header, const u32 nonce, uint64_t *edges, const u32 maxproofs, cuckatoo_stats *stats) {
+  solver_ctx &ctx = *(solver_ctx *)solver;
+  const trimmetrics &metrics = ctx.stats();
+  const u64 start = phasetimer::now();
+  ctx.setheadernonce(header, CUCKATOO_HEADERLEN, nonce);
+  ctx.trimmer.trim();
+  ctx.takestats();
+  if (ctx.cancelled())
+    return CUCKATOO_ECANCELED;
+  stats->trimns += phasetimer::now() - start;
+  stats->graphs++;
+  for (u32 r = 0; r < metrics.nrounds; r++) {
+    if (metrics.phases[r]) {
+      stats->rounds++;
+      if (r+1 == metrics.nrounds || !metrics.phases[r+1])
+        stats->edges += metrics.edges(r);
+    }
+  }
+  // the buckets can't be trusted to keep cycle finding in bounds
+  if (ctx.trimmer.failed)
+    return CUCKATOO_EFAILED;
+  ctx.findcycles();
+  if (ctx.cancelled()) // possibly amid nonce recovery
+    return CUCKATOO_ECANCELED;
+  stats->findcyclesns += metrics.findcycles.ns;
+  u64 matchns = 0;
+  for (u32 id = 0; id < metrics.nthreads; id++)
+    if (metrics.match[id].ns > matchns)
+      matchns = metrics.match[id].ns;
+  stats->matchns += matchns;
+  u32 nproofs = 0;
+  for (u32 s = 0; s < ctx.sols.size() / PROOFSIZE && nproofs < maxproofs; s++) {
+    word_t *prf = &ctx.sols[s * PROOFSIZE];
+    if (verify(prf, ctx.sipkeys()) != POW_OK)
+      continue;
+    for (u32 i = 0; i < PROOFSIZE; i++)
+      edges[nproofs * PROOFSIZE + i] = prf[i];
+    nproofs++;
+  }
+  return nproofs;
+}
+
+void cancel(void *solver) {
+  ((solver_ctx *)solver)->cancel();
+}
+
+void uncancel(void *solver) {
+  ((solver_ctx *)solver)->uncancel();
+}
+
+extern const meanapi api = { create, destroy, solve, cancel, uncancel };
@@ -0,0 +1,193 @@
+// Cuckatoo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2019 John Tromp
+
+#ifndef INCLUDE_METRICS_HPP
+#define INCLUDE_METRICS_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <x86intrin.h>
+
+// what one thread did in one phase of solving
+typedef struct {
+  uint64_t ns;           // wall clock time
+  uint64_t cycles;       // rdtsc ticks
+  uint64_t edges;        // edges output, i.e. surviving the phase
+  uint64_t bytesread;    // from the bucket matrix, not counting thread local buckets
+  uint64_t byteswritten; // to the bucket matrix
+  uint32_t maxnnid;      // largest new name in renaming rounds
+  uint64_t waitns;       // idle at the barrier after the phase
+  uint32_t spills;       // buckets overflowing into the spill arena
+} phasestats;
+
+// start of a phase, for phasestats::ns and cycles
+class phasetimer {
+public:
+  uint64_t ns;
+  uint64_t cycles;
+
+  static uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  }
+  phasetimer() {
+    ns = now();
+    cycles = __rdtsc();
+  }
+};
+
+// per round and per thread statistics of a trim, plus those of cycle finding
+// and nonce recovery. each thread writes only its own entries, so no locking
+// is needed, and all reporting is left to the caller once the threads are done
+class trimmetrics {
+public:
+  uint32_t nthreads;
+  uint32_t nrounds;
+  const char **phases;   // name of phase run in each round, or 0 if not run
+  phasestats *rounds;    // nrounds x nthreads
+  phasestats findcycles; // by the calling thread
+  phasestats *match;     // nthreads, for nonce recovery
+  uint32_t nmatch;       // number of nonce recoveries included in match
+
+  trimmetrics(const uint32_t n_threads, const uint32_t n_rounds) {
+    nthreads = n_threads;
+    nrounds  = n_rounds;
+    phases   = new const char *[nrounds];
+    rounds   = new phasestats[nrounds * nthreads];
+    match    = new phasestats[nthreads];
+    reset();
+  }
+  ~trimmetrics() {
+    delete[] phases;
+    delete[] rounds;
+    delete[] match;
+  }
+  void reset() {
+    memset(phases, 0, nrounds * sizeof(const char *));
+    memset(rounds, 0, nrounds * nthreads * sizeof(phasestats));
+    memset(&findcycles, 0, sizeof(phasestats));
+    memset(match, 0, nthreads * sizeof(phasestats));
+    nmatch = 0;
+  }
+  // take over the trimming statistics of another collector of the same shape
+  void copyrounds(const trimmetrics &other) {
+    memcpy(phases, other.phases, nrounds * sizeof(const char *));
+    memcpy(rounds, other.rounds, nrounds * nthreads * sizeof(phasestats));
+  }
+  phasestats &at(const uint32_t round, const uint32_t id) const {
+    return rounds[round * nthreads + id];
+  }
+  static void stop(phasestats &ps, const phasetimer &t) {
+    ps.ns += phasetimer::now() - t.ns;
+    ps.cycles += __rdtsc() - t.cycles;
+  }
+  void record(const uint32_t round, const uint32_t id, const char *phase, const phasetimer &t,
+              const uint64_t edges, const uint64_t bytesread, const uint64_t byteswritten, const uint32_t maxnnid = 0) {
+    phasestats &ps = at(round, id);
+    stop(ps, t);
+    ps.edges = edges;
+    ps.bytesread = bytesread;
+    ps.byteswritten = byteswritten;
+    ps.maxnnid = maxnnid;
+    if (!id)
+      phases[round] = phase;
+  }
+  // total edges surviving round
+  uint64_t edges(const uint32_t round) const {
+    uint64_t sum = 0;
+    for (uint32_t id = 0; id < nthreads; id++)
+      sum += at(round, id).edges;
+    return sum;
+  }
+
+  // the progress report formerly printed by the threads themselves
+  void printrounds(const bool showall) const {
+    for (uint32_t r = 0; r < nrounds; r++) {
+      const char *phase = phases[r];
+      if (!phase)
+        continue;
+      const bool renaming = strstr(phase, "rename") != 0;
+      for (uint32_t id = 0; id < nthreads; id++) {
+        const phasestats &ps = at(r, id);
+        if (r < 2) {
+          if (!id)
+            printf("%s round %2d size %lu rdtsc: %lu\n", phase, r, ps.edges, ps.cycles);
+        } else if (renaming) {
+          if (showall || !id)
+            printf("%s id %d round %2d size %lu rdtsc: %lu maxnnid %d\n", phase, id, r, ps.edges, ps.cycles, ps.maxnnid);
+        } else if (showall || (!id && !(r & (r+1))))
+          printf("%s id %d round %2d size %lu rdtsc: %lu\n", phase, id, r, ps.edges, ps.cycles);
+      }
+    }
+  }
+  // the edges surviving the last round run, as compared by cuckatoo -A
+  void printtotal() const {
+    uint32_t r = nrounds;
+    while (r && !phases[r-1])
+      r--;
+    if (r)
+      printf("trimmed to %lu edges in %u rounds\n", edges(r-1), r);
+  }
+  // how much of the threads' time went to waiting on the slowest
+  void printwait() const {
+    uint64_t busy = 0, wait = 0;
+    for (uint32_t i = 0; i < nrounds * nthreads; i++) {
+      busy += rounds[i].ns;
+      wait += rounds[i].waitns;
+    }
+    printf("barrier wait %lu us, %.1f%% of %lu us thread time\n", wait/1000, busy+wait ? 100.0*wait/(busy+wait) : 0.0, (busy+wait)/1000);
+  }
+  // the rare rounds in which buckets overflowed
+  void printspills() const {
+    for (uint32_t r = 0; r < nrounds; r++) {
+      uint32_t n = 0;
+      for (uint32_t id = 0; id < nthreads; id++)
+        n += at(r, id).spills;
+      if (n)
+        printf("%s round %2d spilled %u buckets\n", phases[r], r, n);
+    }
+  }
+  void printmatch(const bool showall) const {
+    for (uint32_t id = 0; id < nthreads; id++)
+      if (showall || !id)
+        printf("matchUnodes id %d rdtsc: %lu\n", id, match[id].cycles);
+  }
+  void printfindcycles() const {
+    printf("findcycles rdtsc: %lu\n", findcycles.cycles);
+  }
+
+  // one line JSON object
+  void json(FILE *f, const uint32_t edgebits, const uint32_t nonce) const {
+    fprintf(f, "{\"edgebits\":%u,\"nonce\":%u,\"nthreads\":%u,\"rounds\":[", edgebits, nonce, nthreads);
+    bool first = true;
+    for (uint32_t r = 0; r < nrounds; r++) {
+      if (!phases[r])
+        continue;
+      fprintf(f, "%s{\"round\":%u,\"phase\":\"%s\",\"edges\":%lu,\"threads\":[", first ? "" : ",", r, phases[r], edges(r));
+      for (uint32_t id = 0; id < nthreads; id++)
+        jsonstats(f, at(r, id), id);
+      fprintf(f, "]}");
+      first = false;
+    }
+    fprintf(f, "],\"findcycles\":{\"ns\":%lu,\"cycles\":%lu},\"match\":[", findcycles.ns, findcycles.cycles);
+    for (uint32_t id = 0; nmatch && id < nthreads; id++)
+      fprintf(f, "%s{\"id\":%u,\"ns\":%lu,\"cycles\":%lu}", id ? "," : "", id, match[id].ns, match[id].cycles);
+    fprintf(f, "]}\n");
+  }
+
+private:
+  static void jsonstats(FILE *f, const phasestats &ps, const uint32_t id) {
+    fprintf(f, "%s{\"id\":%u,\"ns\":%lu,\"waitns\":%lu,\"cycles\":%lu,\"edges\":%lu,\"bytesread\":%lu,\"byteswritten\":%lu",
+      id ? "," : "", id, ps.ns, ps.waitns, ps.cycles, ps.edges, ps.bytesread, ps.byteswritten);
+    if (ps.maxnnid)
+      fprintf(f, ",\"maxnnid\":%u", ps.maxnnid);
+    if (ps.spills)
+      fprintf(f, ",\"spills\":%u", ps.spills);
+    fprintf(f, "}");
+  }
+};
+
+#endif // ifdef INCLUDE_METRICS_HPP
@@ -0,0 +1,100 @@
+// Cuckatoo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2019 John Tromp
+
+#ifndef INCLUDE_NUMA_HPP
+#define INCLUDE_NUMA_HPP
+
+// minimal NUMA support straight from sysfs and the raw syscalls,
+// so as not to depend on libnuma being installed
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#define MAXNUMANODES 64
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1 // as in <numaif.h>
+#endif
+
+class numatopology {
+public:
+  uint32_t nnodes;
+#ifdef __linux__
+  cpu_set_t cpus[MAXNUMANODES];
+#endif
+
+  // single node unless sysfs says otherwise
+  numatopology() {
+    nnodes = 1;
+#ifdef __linux__
+    CPU_ZERO(&cpus[0]);
+    for (uint32_t c = 0; c < CPU_SETSIZE; c++)
+      CPU_SET(c, &cpus[0]);
+    uint32_t n;
+    for (n = 0; n < MAXNUMANODES; n++) {
+      char path[64];
+      snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", n);
+      FILE *f = fopen(path, "r");
+      if (!f)
+        break;
+      char list[4096];
+      bool ok = fgets(list, sizeof(list), f) != 0;
+      fclose(f);
+      if (!ok)
+        break;
+      parsecpulist(list, &cpus[n]);
+    }
+    if (n > 0)
+      nnodes = n;
+#endif
+  }
+  // node serving thread id out of nthreads, in contiguous blocks of ids
+  uint32_t node(const uint32_t id, const uint32_t nthreads) const {
+    return (uint64_t)id * nnodes / nthreads;
+  }
+  // restrict the calling thread to the cpus of a node
+  void pin(const uint32_t node) const {
+#ifdef __linux__
+    sched_setaffinity(0, sizeof(cpu_set_t), &cpus[node]);
+#endif
+  }
+  // ask for pages of [p,p+len) to be placed on node. purely a preference,
+  // since first touch by a pinned thread gets the same result where it works
+  void bind(void *p, uint64_t len, const uint32_t node) const {
+#if defined(__linux__) && defined(SYS_mbind)
+    const uint64_t pagemask = 4095;
+    uint64_t start = ((uint64_t)p + pagemask) & ~pagemask;
+    uint64_t end = ((uint64_t)p + len) & ~pagemask;
+    if (end <= start)
+      return;
+    unsigned long nodemask = 1UL << node;
+    syscall(SYS_mbind, start, end - start, MPOL_PREFERRED, &nodemask, MAXNUMANODES+1, 0);
+#endif
+  }
+
+private:
+#ifdef __linux__
+  // cpulist format is like 0-11,24-35
+  static void parsecpulist(const char *list, cpu_set_t *set) {
+    CPU_ZERO(set);
+    while (*list >= '0' && *list <= '9') {
+      char *end;
+      uint32_t lo = strtoul(list, &end, 10), hi = lo;
+      if (*end == '-')
+        hi = strtoul(end+1, &end, 10);
+      for (uint32_t c = lo; c <= hi && c < CPU_SETSIZE; c++)
+        CPU_SET(c, set);
+      list = *end == ',' ? end+1 : end;
+    }
+  }
+#endif
+};
+
+#endif // ifdef INCLUDE_NUMA_HPP
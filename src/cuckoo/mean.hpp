@@ -16,6 +16,7 @@
 #include <assert.h>
 #include <vector>
 #include <bitset>
+#include "../threads/threadpool.hpp"
 #ifdef __APPLE__
 #include "../apple/osx_barrier.h"
 #endif
@@ -228,14 +229,6 @@ struct indexer {
 #define likely(x)   __builtin_expect((x)!=0, 1)
 #define unlikely(x) __builtin_expect((x), 0)
 
-class edgetrimmer; // avoid circular references
-
-typedef struct {
-  u32 id;
-  pthread_t thread;
-  edgetrimmer *et;
-} thread_ctx;
-
 typedef u8 zbucket8[2*NYZ1];
 typedef u16 zbucket16[NTRIMMEDZ];
 typedef u32 zbucket32[NTRIMMEDZ];
@@ -253,6 +246,7 @@ public:
   u32 ntrims;
   u32 nthreads;
   bool showall;
+  threadpool *pool;
   pthread_barrier_t barry;
 
 #if NSIPHASH > 4
@@ -274,10 +268,11 @@ public:
     for (offset_t i=0; i<n; i+=4096)
       *(u32 *)(p+i) = 0;
   }
-  edgetrimmer(const u32 n_threads, const u32 n_trims, const bool show_all) {
+  edgetrimmer(threadpool *workers, const u32 n_trims, const bool show_all) {
     assert(sizeof(matrix<ZBUCKETSIZE>) == NX * sizeof(yzbucket<ZBUCKETSIZE>));
     assert(sizeof(matrix<TBUCKETSIZE>) == NX * sizeof(yzbucket<TBUCKETSIZE>));
-    nthreads = n_threads;
+    pool     = workers;
+    nthreads = pool->nthreads;
     ntrims   = n_trims;
     showall = show_all;
     buckets  = new yzbucket<ZBUCKETSIZE>[NX];
@@ -959,24 +954,11 @@ public:
     tcounts[id] = sumsize/sizeof(u32);
   }
 
+  static void trimworker(void *et, const u32 id) {
+    ((edgetrimmer *)et)->trimmer(id);
+  }
   void trim() {
-    if (nthreads == 1) {
-      trimmer(0);
-      return;
-    }
-    void *etworker(void *vp);
-    thread_ctx *threads = new thread_ctx[nthreads];
-    for (u32 t = 0; t < nthreads; t++) {
-      threads[t].id = t;
-      threads[t].et = this;
-      int err = pthread_create(&threads[t].thread, NULL, etworker, (void *)&threads[t]);
-      assert(err == 0);
-    }
-    for (u32 t = 0; t < nthreads; t++) {
-      int err = pthread_join(threads[t].thread, NULL);
-      assert(err == 0);
-    }
-    delete[] threads;
+    pool->run(trimworker, this);
   }
   void barrier() {
     int rc = pthread_barrier_wait(&barry);
@@ -1021,13 +1003,6 @@ public:
   }
 };
 
-void *etworker(void *vp) {
-  thread_ctx *tp = (thread_ctx *)vp;
-  tp->et->trimmer(tp->id);
-  pthread_exit(NULL);
-  return 0;
-}
-
 #define NODEBITS (EDGEBITS + 1)
 
 // grow with cube root of size, hardly affected by trimming
@@ -1041,17 +1016,9 @@ int nonce_cmp(const void *a, const void *b) {
 
 typedef word_t proof[PROOFSIZE];
 
-// break circular reference with forward declaration
-class solver_ctx;
-
-typedef struct {
-  u32 id;
-  pthread_t thread;
-  solver_ctx *solver;
-} match_ctx;
-
 class solver_ctx {
 public:
+  threadpool pool;
   edgetrimmer *trimmer;
   u32 *cuckoo = 0;
   bool showcycle;
@@ -1060,8 +1027,8 @@ public:
   std::bitset<NXY> uxymap;
   std::vector<word_t> sols; // concatanation of all proof's indices
 
-  solver_ctx(const u32 n_threads, const u32 n_trims, bool allrounds, bool show_cycle) {
-    trimmer = new edgetrimmer(n_threads, n_trims, allrounds);
+  solver_ctx(const u32 n_threads, const u32 n_trims, bool allrounds, bool show_cycle) : pool(n_threads) {
+    trimmer = new edgetrimmer(&pool, n_trims, allrounds);
     showcycle = show_cycle;
     cuckoo = 0;
   }
@@ -1077,7 +1044,7 @@ public:
     return sizeof(matrix<ZBUCKETSIZE>);
   }
   u32 threadbytes() const {
-    return sizeof(thread_ctx) + sizeof(yzbucket<TBUCKETSIZE>) + sizeof(zbucket8) + sizeof(zbucket16) + sizeof(zbucket32);
+    return sizeof(threadpool::worker_ctx) + sizeof(yzbucket<TBUCKETSIZE>) + sizeof(zbucket8) + sizeof(zbucket16) + sizeof(zbucket32);
   }
   void recordedge(const u32 i, const u32 u2, const u32 v2) {
     const u32 u1 = u2/2;
@@ -1121,20 +1088,8 @@ public:
     printf("\n");
     if (showcycle) {
 #ifndef SAVEEDGES
-      void *matchworker(void *vp);
-
       sols.resize(sols.size() + PROOFSIZE);
-      match_ctx *threads = new match_ctx[trimmer->nthreads];
-      for (u32 t = 0; t < trimmer->nthreads; t++) {
-        threads[t].id = t;
-        threads[t].solver = this;
-        int err = pthread_create(&threads[t].thread, NULL, matchworker, (void *)&threads[t]);
-        assert(err == 0);
-      }
-      for (u32 t = 0; t < trimmer->nthreads; t++) {
-        int err = pthread_join(threads[t].thread, NULL);
-        assert(err == 0);
-      }
+      pool.run(matchworker, this);
 #endif
       qsort(&sols[sols.size()-PROOFSIZE], PROOFSIZE, sizeof(u32), nonce_cmp);
     }
@@ -1210,12 +1165,16 @@ public:
     return sols.size() / PROOFSIZE;
   }
 
-  void *matchUnodes(match_ctx *mc) {
+  static void matchworker(void *solver, const u32 id) {
+    ((solver_ctx *)solver)->matchUnodes(id);
+  }
+
+  void matchUnodes(const u32 id) {
     u64 rdtsc0, rdtsc1;
   
     rdtsc0 = __rdtsc();
-    const u32 starty = NY *  mc->id    / trimmer->nthreads;
-    const u32   endy = NY * (mc->id+1) / trimmer->nthreads;
+    const u32 starty = NY *  id    / trimmer->nthreads;
+    const u32   endy = NY * (id+1) / trimmer->nthreads;
     u32 edge = starty << YZBITS, endedge = edge + NYZ;
   #if NSIPHASH == 4
     static const __m128i vnodemask = {EDGEMASK, EDGEMASK};
@@ -1325,15 +1284,6 @@ public:
       }
     }
     rdtsc1 = __rdtsc();
-    if (trimmer->showall || !mc->id) printf("matchUnodes id %d rdtsc: %lu\n", mc->id, rdtsc1-rdtsc0);
-    pthread_exit(NULL);
-    return 0;
+    if (trimmer->showall || !id) printf("matchUnodes id %d rdtsc: %lu\n", id, rdtsc1-rdtsc0);
   }
 };
-
-void *matchworker(void *vp) {
-  match_ctx *tp = (match_ctx *)vp;
-  tp->solver->matchUnodes(tp);
-  pthread_exit(NULL);
-  return 0;
-}
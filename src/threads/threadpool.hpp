@@ -0,0 +1,121 @@
+// Cuck(at)oo Cycle, a memory-hard proof-of-work
+// Copyright (c) 2013-2019 John Tromp
+
+#ifndef INCLUDE_THREADPOOL_HPP
+#define INCLUDE_THREADPOOL_HPP
+
+#include <stdint.h>
+#include <pthread.h>
+#include <assert.h>
+
+// a fixed set of long-lived worker threads that park on a condition
+// variable between jobs. a job is a function run once on every worker,
+// each with its own id in 0..nthreads-1, much like the bodies of the
+// pthread_create'd workers it replaces, minus the creation and join costs
+class threadpool {
+public:
+  typedef void (*job_t)(void *arg, const uint32_t id);
+
+  typedef struct {
+    uint32_t id;
+    pthread_t thread;
+    threadpool *pool;
+  } worker_ctx;
+
+  uint32_t nthreads;
+
+  threadpool(const uint32_t n_threads) {
+    nthreads = n_threads;
+    job = 0;
+    arg = 0;
+    generation = 0;
+    nbusy = 0;
+    quit = false;
+    int err = pthread_mutex_init(&lock, NULL);
+    assert(err == 0);
+    err = pthread_cond_init(&wake, NULL);
+    assert(err == 0);
+    err = pthread_cond_init(&idle, NULL);
+    assert(err == 0);
+    workers = new worker_ctx[nthreads];
+    for (uint32_t t = 0; t < nthreads; t++) {
+      workers[t].id = t;
+      workers[t].pool = this;
+      err = pthread_create(&workers[t].thread, NULL, park, (void *)&workers[t]);
+      assert(err == 0);
+    }
+  }
+  ~threadpool() {
+    pthread_mutex_lock(&lock);
+    quit = true;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+    for (uint32_t t = 0; t < nthreads; t++) {
+      int err = pthread_join(workers[t].thread, NULL);
+      assert(err == 0);
+    }
+    delete[] workers;
+    pthread_cond_destroy(&idle);
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&lock);
+  }
+  // start fn(fnarg, id) on all workers and return without waiting
+  void launch(job_t fn, void *fnarg) {
+    pthread_mutex_lock(&lock);
+    while (nbusy) // at most one job in flight
+      pthread_cond_wait(&idle, &lock);
+    job = fn;
+    arg = fnarg;
+    nbusy = nthreads;
+    generation++;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+  }
+  // wait until all workers have finished the last launched job
+  void wait() {
+    pthread_mutex_lock(&lock);
+    while (nbusy)
+      pthread_cond_wait(&idle, &lock);
+    pthread_mutex_unlock(&lock);
+  }
+  void run(job_t fn, void *fnarg) {
+    launch(fn, fnarg);
+    wait();
+  }
+
+private:
+  worker_ctx *workers;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t idle;
+  job_t job;
+  void *arg;
+  uint64_t generation;
+  uint32_t nbusy;
+  bool quit;
+
+  static void *park(void *vp) {
+    worker_ctx *wc = (worker_ctx *)vp;
+    threadpool *tp = wc->pool;
+    uint64_t seen = 0;
+    pthread_mutex_lock(&tp->lock);
+    for (;;) {
+      while (tp->generation == seen && !tp->quit)
+        pthread_cond_wait(&tp->wake, &tp->lock);
+      if (tp->quit)
+        break;
+      seen = tp->generation;
+      job_t fn = tp->job;
+      void *fnarg = tp->arg;
+      pthread_mutex_unlock(&tp->lock);
+      fn(fnarg, wc->id);
+      pthread_mutex_lock(&tp->lock);
+      if (--tp->nbusy == 0)
+        pthread_cond_broadcast(&tp->idle);
+    }
+    pthread_mutex_unlock(&tp->lock);
+    return 0;
+  }
+};
+
+#endif // ifdef INCLUDE_THREADPOOL_HPP